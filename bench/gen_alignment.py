@@ -0,0 +1,101 @@
+# Function: Generate synthetic star-style alignments shaped like the test datasets in README.md
+#
+# The real datasets cannot be fetched offline, so each shape reproduces the
+# number of sequences, the average length and the similarity of one dataset.
+# Rows are substituted copies of a random reference; gappy insertion blocks
+# carried by a minority of rows imitate what star alignment tools leave behind.
+
+import argparse
+import random
+import sys
+
+# name: (sequences, length, similarity)
+SHAPES = {
+    "23s_rrna":         (500,   3120,  0.92),
+    "sars_cov_2_156":   (156,   29000, 0.99),
+    "sars_cov_2_24310": (24310, 29000, 0.99),
+    "16s_like":         (100,   1550,  0.90),
+    "mt_like":          (100,   16000, 0.90),
+    "sars_cov_2_like":  (100,   29000, 0.90),
+    "cipres_128":       (255,   1550,  0.80),
+    "cipres_256":       (511,   1550,  0.80),
+    "cipres_512":       (1023,  1550,  0.80),
+    "cipres_1024":      (2047,  1550,  0.80),
+    "cipres_2048":      (4095,  1550,  0.80),
+    "cipres_4096":      (8191,  1550,  0.80),
+    "rows_1m":          (1000000, 400, 0.75),
+}
+
+
+def make_alignment(rows, length, similarity, seed=1, garbage=0):
+    rng = random.Random(seed)
+    ref = [rng.choice("ACGT") for _ in range(length)]
+    divergence = 1.0 - similarity
+
+    # Insertion blocks relative to the reference, at sorted positions
+    block_count = max(1, int(length * divergence / 20))
+    positions = sorted(rng.sample(range(1, length), min(block_count, length - 1)))
+    blocks = []
+    for pos in positions:
+        width = rng.randint(5, 30)
+        carriers = set(rng.sample(range(rows), max(1, int(rows * rng.uniform(0.05, 0.4)))))
+        blocks.append((pos, width, carriers))
+
+    # Garbage rows are the only carriers of a block of their own
+    garbage_rows = rng.sample(range(rows), min(garbage, rows))
+    for row in garbage_rows:
+        blocks.append((rng.randint(1, length - 1), rng.randint(15, 40), {row}))
+    blocks.sort(key=lambda b: b[0])
+
+    out = []
+    for r in range(rows):
+        seq = list(ref)
+        for _ in range(int(length * divergence * 0.8)):
+            seq[rng.randrange(length)] = rng.choice("ACGT")
+        for _ in range(int(length * divergence * 0.02)):
+            start = rng.randrange(length)
+            for j in range(start, min(length, start + rng.randint(1, 4))):
+                seq[j] = "-"
+        pieces = []
+        prev = 0
+        for pos, width, carriers in blocks:
+            pieces.append("".join(seq[prev:pos]))
+            if r in carriers:
+                pieces.append("".join(rng.choice("ACGT-") if rng.random() < 0.2 else rng.choice("ACGT") for _ in range(width)))
+            else:
+                pieces.append("-" * width)
+            prev = pos
+        pieces.append("".join(seq[prev:]))
+        out.append("".join(pieces))
+    return out
+
+
+def write_fasta(f, sequences, line_length=80):
+    for i, seq in enumerate(sequences):
+        f.write(">seq%d\n" % i)
+        for j in range(0, len(seq), line_length):
+            f.write(seq[j:j + line_length] + "\n")
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Generate a synthetic alignment shaped like a ReAlign-Star test dataset.")
+    parser.add_argument("shape", choices=sorted(SHAPES), help="dataset shape")
+    parser.add_argument("-o", "--output", help="output FASTA (default: stdout)")
+    parser.add_argument("--rows", type=int, help="override the number of sequences")
+    parser.add_argument("--length", type=int, help="override the average length")
+    parser.add_argument("--similarity", type=float, help="override the similarity")
+    parser.add_argument("--garbage", type=int, default=0, help="number of divergent sequences to plant")
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+
+    rows, length, similarity = SHAPES[args.shape]
+    rows = args.rows or rows
+    length = args.length or length
+    similarity = args.similarity or similarity
+
+    sequences = make_alignment(rows, length, similarity, args.seed, args.garbage)
+    if args.output:
+        with open(args.output, "w") as f:
+            write_fasta(f, sequences)
+    else:
+        write_fasta(sys.stdout, sequences)
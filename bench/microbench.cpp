@@ -0,0 +1,156 @@
+// Microbenchmarks for the hot helpers of ReAlign-Star.
+// Usage: microbench <alignment.fasta> [repeats] [threads]
+// Prints one JSON object per benchmark with the median wall time in seconds.
+
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <functional>
+#include <thread>
+#include "Fasta.h"
+#include "GapRegion.h"
+#include "Garbage.h"
+#include "Report.h"
+
+std::string tmp_folder;
+unsigned mock_latency_ms = 0;
+unsigned thread_count = 1;
+ResourceBudget budget;
+Prefilter prefilter;
+ScoringScheme scoring;
+ApproximateScore approximate_score;
+MemoryPlacement placement;
+RemoteWorkers remote_workers;
+Logger logger;
+Report report;
+
+static double median_seconds(int repeats, const std::function<void()> &body) {
+    std::vector<double> times;
+    for (int i = 0; i < repeats; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        body();
+        times.push_back(Report::seconds_since(start));
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+static void emit(const std::string &name, double seconds) {
+    std::cout << "{\"name\": \"" << name << "\", \"seconds\": " << seconds << "}" << std::endl;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <alignment.fasta> [repeats] [threads]" << std::endl;
+        return 1;
+    }
+    const int repeats = argc > 2 ? atoi(argv[2]) : 5;
+    const unsigned threads = argc > 3 ? std::max(1, atoi(argv[3])) : std::max(1u, std::thread::hardware_concurrency());
+    // Every output line is a JSON record, so nothing is logged
+    logger.set_level(0);
+
+    std::ifstream ifs(argv[1]);
+    std::stringstream raw;
+    raw << ifs.rdbuf();
+    const std::string text = raw.str();
+
+    utils::Fasta alignment;
+    emit("fasta_read", median_seconds(repeats, [&] {
+        std::istringstream is(text);
+        alignment = utils::Fasta(is);
+    }));
+
+    // score() is timed over a block-sized column range, as realign_block uses it
+    const unsigned width = alignment.sequences[0].size();
+    const unsigned block_end = std::min(width, 200u);
+    volatile long long sink = 0;
+    emit("score", median_seconds(repeats, [&] {
+        sink = score(alignment.sequences, 0, block_end);
+    }));
+
+    emit("gap_index", median_seconds(repeats, [&] {
+        sink = utils::GapIndex(alignment.sequences).live_rows();
+    }));
+
+    // The main pipeline scans on the index it built at load
+    const utils::GapIndex gap_index(alignment.sequences);
+    emit("scan_sequences_indexed", median_seconds(repeats, [&] {
+        sink = scan_sequences(gap_index, 10).size();
+    }));
+
+    emit("scan_sequences", median_seconds(repeats, [&] {
+        sink = scan_sequences(alignment.sequences, 10).size();
+    }));
+
+    emit("remove_all_gap_columns", median_seconds(repeats, [&] {
+        std::vector<std::string> copy = alignment.sequences;
+        remove_all_gap_columns(copy);
+        sink = copy.size();
+    }));
+
+    emit("cut_and_write", median_seconds(repeats, [&] {
+        std::ostringstream os;
+        for (const auto &sequence : alignment.sequences) {
+            utils::Fasta::cut_and_write(os, sequence);
+        }
+        sink = os.tellp();
+    }));
+
+    // Column scans and block scoring over the whole alignment, threads at a time, on a fresh
+    // copy of the rows placed by each memory placement policy
+    const std::pair<const char *, std::pair<MemoryPlacement::HugePages, MemoryPlacement::Numa>> policies[] = {
+        {"default", {MemoryPlacement::HUGE_PAGES_OFF, MemoryPlacement::NUMA_OFF}},
+        {"thp", {MemoryPlacement::HUGE_PAGES_TRANSPARENT, MemoryPlacement::NUMA_OFF}},
+        {"collapse", {MemoryPlacement::HUGE_PAGES_COLLAPSE, MemoryPlacement::NUMA_OFF}},
+        {"interleave", {MemoryPlacement::HUGE_PAGES_TRANSPARENT, MemoryPlacement::NUMA_INTERLEAVE}},
+        {"partition", {MemoryPlacement::HUGE_PAGES_TRANSPARENT, MemoryPlacement::NUMA_PARTITION}},
+    };
+    auto in_parallel = [&](const std::function<void(size_t, size_t)> &columns) {
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < threads; ++t) {
+            workers.emplace_back([&, t] {
+                placement.pin_worker(t);
+                columns(width * t / threads, width * (t + 1) / threads);
+            });
+        }
+        for (auto &worker : workers) {
+            worker.join();
+        }
+    };
+    for (const auto &[name, policy] : policies) {
+        placement.huge_pages = policy.first;
+        placement.numa = MemoryPlacement::NUMA_OFF;
+        if (policy.second == MemoryPlacement::NUMA_INTERLEAVE) placement.select_numa("interleave");
+        if (policy.second == MemoryPlacement::NUMA_PARTITION) placement.select_numa("partition");
+        std::vector<std::string> rows = alignment.sequences;
+        placement.apply(rows);
+
+        emit(std::string("column_scan_parallel_") + name, median_seconds(repeats, [&] {
+            std::atomic<size_t> gaps{0};
+            in_parallel([&](size_t first, size_t last) {
+                size_t local = 0;
+                for (size_t j = first; j < last; ++j) {
+                    for (const auto &row : rows) {
+                        local += row[j] == '-';
+                    }
+                }
+                gaps += local;
+            });
+            sink = gaps;
+        }));
+        emit(std::string("score_parallel_") + name, median_seconds(repeats, [&] {
+            std::atomic<long long> total{0};
+            in_parallel([&](size_t first, size_t last) {
+                long long local = 0;
+                for (size_t j = first; j < last; j += 200) {
+                    local += score(rows, j, std::min(last, j + 200));
+                }
+                total += local;
+            });
+            sink = total;
+        }));
+    }
+
+    (void) sink;
+    return 0;
+}
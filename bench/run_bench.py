@@ -0,0 +1,138 @@
+# Function: Benchmark suite and performance-regression check for ReAlign-Star
+#
+# Generates synthetic datasets (bench/gen_alignment.py), runs the
+# microbenchmarks (bench/microbench) and end-to-end timings of realign_star
+# with the built-in mock aligner (or the stub scripts in bench/stub), writes
+# the results as JSON and compares them against a baseline.
+
+import argparse
+import json
+import os
+import platform
+import subprocess
+import sys
+import tempfile
+
+from gen_alignment import SHAPES, make_alignment, write_fasta
+
+BENCH_DIR = os.path.dirname(os.path.abspath(__file__))
+ROOT_DIR = os.path.dirname(BENCH_DIR)
+DATA_DIR = os.path.join(BENCH_DIR, "data")
+
+# suite: (microbenchmark datasets, end-to-end datasets)
+SUITES = {
+    "quick":   (["23s_rrna"],
+                ["16s_like", "23s_rrna", "cipres_128"]),
+    "default": (["23s_rrna", "sars_cov_2_156"],
+                ["16s_like", "23s_rrna", "cipres_128", "cipres_1024", "mt_like", "sars_cov_2_156", "sars_cov_2_like"]),
+    "full":    (["23s_rrna", "sars_cov_2_156", "cipres_4096"],
+                sorted(SHAPES)),
+    "million": (["rows_1m"],
+                ["rows_1m"]),
+}
+
+# Datasets that also get planted garbage sequences, to time the profile merge path
+GARBAGE = {"23s_rrna": 2, "cipres_128": 2}
+
+
+def dataset(name):
+    path = os.path.join(DATA_DIR, name + ".fasta")
+    if not os.path.exists(path):
+        os.makedirs(DATA_DIR, exist_ok=True)
+        rows, length, similarity = SHAPES[name]
+        print("Generating %s (%d x %d)" % (name, rows, length), flush=True)
+        with open(path, "w") as f:
+            write_fasta(f, make_alignment(rows, length, similarity, seed=1, garbage=GARBAGE.get(name, 0)))
+    return path
+
+
+def run_micro(name, repeats):
+    out = subprocess.run([os.path.join(BENCH_DIR, "microbench"), dataset(name), str(repeats)],
+                         check=True, capture_output=True, text=True).stdout
+    results = {}
+    for line in out.splitlines():
+        record = json.loads(line)
+        results["micro/%s/%s" % (name, record["name"])] = record["seconds"]
+    return results
+
+
+def run_e2e_once(name, extra_args, aligner):
+    env = dict(os.environ)
+    if aligner == "stub":
+        env["PATH"] = os.path.join(BENCH_DIR, "stub") + os.pathsep + env["PATH"]
+        extra_args = ["-m", "mafft"] + extra_args
+    else:
+        extra_args = ["-m", "mock"] + extra_args
+    with tempfile.TemporaryDirectory() as tmp:
+        report_file = os.path.join(tmp, "report.json")
+        command = [os.path.join(ROOT_DIR, "realign_star"), "-i", dataset(name), "-o", os.path.join(tmp, "out.fasta"),
+                   "-r", report_file, "-v", "0"] + extra_args
+        subprocess.run(command, check=True, env=env, stdout=subprocess.DEVNULL)
+        with open(report_file) as f:
+            report = json.load(f)
+    results = {"e2e/%s/total" % name: report["total_seconds"]}
+    for stage in report["stages"]:
+        results["e2e/%s/%s" % (name, stage["name"].replace(" ", "_"))] = stage["seconds"]
+    results["e2e/%s/aligner" % name] = sum(b["aligner_seconds"] for b in report["blocks"])
+    return results
+
+
+def run_e2e(name, extra_args, aligner, repeats):
+    runs = [run_e2e_once(name, extra_args, aligner) for _ in range(repeats)]
+    return {key: sorted(run[key] for run in runs)[repeats // 2] for key in runs[0]}
+
+
+def compare(results, baseline, tolerance, noise_floor):
+    regressions = []
+    print("%-48s %12s %12s %8s" % ("benchmark", "baseline", "current", "ratio"))
+    for key in sorted(results):
+        if key not in baseline:
+            continue
+        base, curr = baseline[key], results[key]
+        ratio = curr / base if base > 0 else float("inf")
+        flag = ""
+        if curr > base * (1 + tolerance) and curr - base > noise_floor:
+            flag = "  REGRESSION"
+            regressions.append(key)
+        print("%-48s %12.6f %12.6f %8.2f%s" % (key, base, curr, ratio, flag))
+    return regressions
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Run the ReAlign-Star benchmark suite.")
+    parser.add_argument("--suite", choices=sorted(SUITES), default="quick")
+    parser.add_argument("--repeats", type=int, default=5, help="repeats per microbenchmark (median is kept)")
+    parser.add_argument("--aligner", choices=["mock", "stub"], default="mock",
+                        help="built-in '-m mock' backend, or the stub mafft/java scripts in bench/stub")
+    parser.add_argument("--e2e-repeats", type=int, default=3, help="repeats per end-to-end run (median is kept)")
+    parser.add_argument("--output", default=os.path.join(BENCH_DIR, "results.json"))
+    parser.add_argument("--baseline", default=os.path.join(BENCH_DIR, "baseline.json"))
+    parser.add_argument("--update-baseline", action="store_true", help="overwrite the baseline with these results")
+    parser.add_argument("--tolerance", type=float, default=0.3, help="allowed slowdown ratio before flagging")
+    parser.add_argument("--noise-floor", type=float, default=0.005, help="ignore slowdowns below this many seconds")
+    parser.add_argument("--args", default="", help="extra realign_star arguments for end-to-end runs")
+    args = parser.parse_args()
+
+    micro_sets, e2e_sets = SUITES[args.suite]
+    results = {}
+    for name in micro_sets:
+        results.update(run_micro(name, args.repeats))
+    for name in e2e_sets:
+        results.update(run_e2e(name, args.args.split(), args.aligner, args.e2e_repeats))
+
+    document = {"suite": args.suite, "aligner": args.aligner, "machine": platform.node(), "platform": platform.platform(), "results": results}
+    with open(args.output, "w") as f:
+        json.dump(document, f, indent=2, sort_keys=True)
+    print("Results written to", args.output)
+
+    if args.update_baseline:
+        with open(args.baseline, "w") as f:
+            json.dump(document, f, indent=2, sort_keys=True)
+        print("Baseline updated:", args.baseline)
+    elif os.path.exists(args.baseline):
+        with open(args.baseline) as f:
+            baseline = json.load(f)["results"]
+        regressions = compare(results, baseline, args.tolerance, args.noise_floor)
+        if regressions:
+            print("%d benchmark(s) regressed beyond %.0f%%" % (len(regressions), args.tolerance * 100))
+            sys.exit(1)
@@ -0,0 +1,73 @@
+#ifndef REFINE_STAR_ALIGNERPOLICY_H
+#define REFINE_STAR_ALIGNERPOLICY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// One row of the policy table: blocks of the backend with at most max_rows rows and
+// max_columns columns run with these arguments, and may use up to max_threads cores
+struct AlignerPolicy {
+    const char *msa;
+    size_t max_rows;
+    size_t max_columns;
+    const char *arguments;
+    unsigned max_threads;
+};
+
+// How one aligner call went: the arguments and cores it got, its estimated and measured
+// footprint and its wall time
+struct AlignerRun {
+    std::string arguments;
+    unsigned threads = 1;
+    uint64_t estimated_bytes = 0;
+    long peak_rss_kb = 0;
+    double seconds = 0;
+};
+
+// Rows are tried in order and the first match wins; the last row of each backend has no limit.
+// mafft: L-INS-i (accurate, O(rows^2) pairwise alignments) for small blocks, the default
+// FFT-NS-2 for medium ones and FFT-NS-1 (a single guide tree) for large ones, the latter two
+// with --thread when the scheduler has spare cores. muscle3: the full 16 iterations only on
+// small blocks, since its time and memory grow fast with rows. halign3 keeps its defaults.
+constexpr AlignerPolicy aligner_policies[] = {
+    {"mafft", 200, 2000, "--localpair --maxiterate 1000", 1},
+    {"mafft", 2000, SIZE_MAX, "--retree 2", 4},
+    {"mafft", SIZE_MAX, SIZE_MAX, "--retree 1", 8},
+    {"muscle3", 100, SIZE_MAX, "", 1},
+    {"muscle3", SIZE_MAX, SIZE_MAX, "-maxiters 2", 1},
+    {"halign3", SIZE_MAX, SIZE_MAX, "", 1},
+    {"mock", SIZE_MAX, SIZE_MAX, "", 1},
+};
+
+// Whether the policy table has rows for this backend, i.e. it is one ReAlign-Star can run
+bool is_supported_msa(const std::string &msa) {
+    for (const auto &policy : aligner_policies) {
+        if (msa == policy.msa) return true;
+    }
+    return false;
+}
+
+// Policy row of a block; a backend without rows gets its defaults on one core, so callers that
+// did not check is_supported_msa still get a valid row
+const AlignerPolicy &select_policy(const std::string &msa, size_t rows, size_t columns) {
+    static constexpr AlignerPolicy defaults = {"", SIZE_MAX, SIZE_MAX, "", 1};
+    const AlignerPolicy *fallback = &defaults;
+    for (const auto &policy : aligner_policies) {
+        if (msa != policy.msa) continue;
+        fallback = &policy;
+        if (rows <= policy.max_rows && columns <= policy.max_columns) break;
+    }
+    return *fallback;
+}
+
+// Full argument string for a run with the given number of cores
+std::string policy_arguments(const std::string &msa, const AlignerPolicy &policy, unsigned threads) {
+    std::string arguments = policy.arguments;
+    if (msa == "mafft" && threads > 1) {
+        arguments += (arguments.empty() ? "" : " ") + std::string("--thread ") + std::to_string(threads);
+    }
+    return arguments;
+}
+
+#endif //REFINE_STAR_ALIGNERPOLICY_H
@@ -0,0 +1,204 @@
+#include "AlignmentStore.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+utils::AlignmentStore::AlignmentStore(const std::string &file_path)
+{
+    int fd = open(file_path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        std::cerr << "Error: cannot open file " << file_path << std::endl;
+        std::cerr << "Please check that the file path is correct and make sure the file exists." << std::endl;
+        exit(1);
+    }
+    size = st.st_size;
+    void *mapped = size >= sizeof(Header) ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        std::cerr << "Error: cannot map file " << file_path << std::endl;
+        exit(1);
+    }
+    data = static_cast<const char *>(mapped);
+
+    header = reinterpret_cast<const Header *>(data);
+    if (memcmp(header->magic, magic, sizeof(magic)) != 0 || header->version != version
+        || header->row_bases_offset + header->rows * sizeof(uint64_t) > size) {
+        std::cerr << "Error: " << file_path << " is not a valid ReAlign-Star alignment store." << std::endl;
+        exit(1);
+    }
+
+    id_offsets = reinterpret_cast<const uint64_t *>(data + header->ids_offset);
+    names = reinterpret_cast<const char *>(id_offsets + header->rows + 1);
+    packed_rows = reinterpret_cast<const uint8_t *>(data + header->rows_offset);
+    column_gap_counts = reinterpret_cast<const uint32_t *>(data + header->column_gaps_offset);
+    row_base_counts = reinterpret_cast<const uint64_t *>(data + header->row_bases_offset);
+
+    for (unsigned byte = 0; byte < 256; ++byte) {
+        pair_table[byte][0] = header->alphabet[byte & 0xF];
+        pair_table[byte][1] = header->alphabet[byte >> 4];
+    }
+}
+
+utils::AlignmentStore::~AlignmentStore()
+{
+    if (data) munmap(const_cast<char *>(data), size);
+}
+
+bool utils::AlignmentStore::is_store(const std::string &file_path)
+{
+    std::ifstream ifs(file_path, std::ios::binary);
+    char head[sizeof(magic)] = {};
+    ifs.read(head, sizeof(head));
+    return ifs && memcmp(head, magic, sizeof(magic)) == 0;
+}
+
+std::string_view utils::AlignmentStore::identification(size_t row) const
+{
+    return std::string_view(names + id_offsets[row], id_offsets[row + 1] - id_offsets[row]);
+}
+
+void utils::AlignmentStore::read_columns(size_t row, size_t start, size_t end, std::string &out) const
+{
+    if (end > header->columns) end = header->columns;
+    if (start >= end) return;
+
+    const uint8_t *packed = packed_rows + row * header->row_stride;
+    if (header->bits_per_symbol == 8) {
+        out.append(reinterpret_cast<const char *>(packed) + start, end - start);
+        return;
+    }
+
+    const size_t offset = out.size();
+    out.resize(offset + end - start);
+    char *dst = &out[offset];
+    size_t column = start;
+    if (column & 1) {
+        *dst++ = pair_table[packed[column >> 1]][1];
+        ++column;
+    }
+    for (; column + 1 < end; column += 2, dst += 2) {
+        memcpy(dst, pair_table[packed[column >> 1]], 2);
+    }
+    if (column < end) {
+        *dst = pair_table[packed[column >> 1]][0];
+    }
+}
+
+utils::Fasta utils::AlignmentStore::to_fasta() const
+{
+    Fasta fasta;
+    fasta.identifications.reserve(rows());
+    fasta.sequences.resize(rows());
+    for (size_t i = 0; i < rows(); ++i) {
+        fasta.identifications.emplace_back(identification(i));
+        read_columns(i, 0, header->columns, fasta.sequences[i]);
+    }
+    return fasta;
+}
+
+void utils::AlignmentStore::import_fasta(const FastaIndex &index, const std::string &file_path)
+{
+    const size_t rows = index.rows();
+    const size_t columns = rows ? index.length(0) : 0;
+    std::string row;
+
+    // Pass 1: the alphabet decides between 4-bit and 8-bit rows
+    bool used[256] = {};
+    used[static_cast<unsigned char>('-')] = true;
+    for (size_t i = 0; i < rows; ++i) {
+        if (index.length(i) != columns) {
+            std::cerr << "Error: sequences are not of equal length, cannot pack an unaligned file." << std::endl;
+            exit(1);
+        }
+        row.clear();
+        index.read_columns(i, 0, columns, row);
+        for (char c : row) used[static_cast<unsigned char>(c)] = true;
+    }
+
+    Header header = {};
+    memcpy(header.magic, magic, sizeof(magic));
+    header.version = version;
+    uint8_t codes[256] = {};
+    unsigned symbol_count = 0;
+    header.alphabet[symbol_count++] = '-';
+    for (unsigned c = 0; c < 256; ++c) {
+        if (!used[c] || c == '-') continue;
+        if (symbol_count < 16) {
+            codes[c] = symbol_count;
+            header.alphabet[symbol_count] = static_cast<char>(c);
+        }
+        ++symbol_count;
+    }
+    header.bits_per_symbol = symbol_count <= 16 ? 4 : 8;
+
+    auto align8 = [](uint64_t n) { return (n + 7) & ~uint64_t(7); };
+    uint64_t names_size = 0;
+    for (size_t i = 0; i < rows; ++i) names_size += index.identification(i).size();
+
+    header.rows = rows;
+    header.columns = columns;
+    header.row_stride = align8(header.bits_per_symbol == 4 ? (columns + 1) / 2 : columns);
+    header.ids_offset = align8(sizeof(Header));
+    header.rows_offset = align8(header.ids_offset + (rows + 1) * sizeof(uint64_t) + names_size);
+    header.column_gaps_offset = header.rows_offset + rows * header.row_stride;
+    header.row_bases_offset = align8(header.column_gaps_offset + columns * sizeof(uint32_t));
+
+    std::ofstream ofs(file_path, std::ios::binary);
+    if (!ofs) {
+        std::cerr << "Error: cannot open file " << file_path << std::endl;
+        exit(1);
+    }
+    auto pad_to = [&ofs](uint64_t offset) {
+        static const char zeros[8] = {};
+        ofs.write(zeros, offset - static_cast<uint64_t>(ofs.tellp()));
+    };
+
+    ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    pad_to(header.ids_offset);
+    uint64_t name_offset = 0;
+    for (size_t i = 0; i <= rows; ++i) {
+        ofs.write(reinterpret_cast<const char *>(&name_offset), sizeof(name_offset));
+        if (i < rows) name_offset += index.identification(i).size();
+    }
+    for (size_t i = 0; i < rows; ++i) {
+        std::string_view id = index.identification(i);
+        ofs.write(id.data(), id.size());
+    }
+    pad_to(header.rows_offset);
+
+    // Pass 2: pack rows and count gaps
+    std::vector<uint32_t> column_gaps(columns, 0);
+    std::vector<uint64_t> row_bases(rows, 0);
+    std::vector<uint8_t> packed(header.row_stride);
+    for (size_t i = 0; i < rows; ++i) {
+        row.clear();
+        index.read_columns(i, 0, columns, row);
+        std::fill(packed.begin(), packed.end(), 0);
+        for (size_t j = 0; j < columns; ++j) {
+            const unsigned char c = row[j];
+            if (c == '-') {
+                ++column_gaps[j];
+            } else {
+                ++row_bases[i];
+            }
+            if (header.bits_per_symbol == 8) {
+                packed[j] = c;
+            } else {
+                packed[j >> 1] |= codes[c] << ((j & 1) * 4);
+            }
+        }
+        ofs.write(reinterpret_cast<const char *>(packed.data()), packed.size());
+    }
+
+    ofs.write(reinterpret_cast<const char *>(column_gaps.data()), columns * sizeof(uint32_t));
+    pad_to(header.row_bases_offset);
+    ofs.write(reinterpret_cast<const char *>(row_bases.data()), rows * sizeof(uint64_t));
+    ofs.close();
+}
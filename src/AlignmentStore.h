@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Fasta.h"
+#include "FastaIndex.h"
+
+namespace utils
+{
+
+    // Binary alignment container, memory-mapped for instant startup and random column access.
+    //
+    // Layout (little endian): a fixed Header, the ID table (rows + 1 offsets followed by the
+    // concatenated names), the packed rows, the per-column gap counts and the per-row base
+    // counts. Rows are packed with 4 bits per column when the alignment uses at most 16
+    // symbols ('-' is always code 0), and 1 byte per column otherwise. Every row has the same
+    // stride, so the byte offset of any column is computed rather than looked up.
+    class AlignmentStore
+    {
+    public:
+        static constexpr char magic[8] = {'R', 'S', 'T', 'A', 'R', 'A', 'L', 'N'};
+        static constexpr uint32_t version = 1;
+
+        struct Header
+        {
+            char magic[8];
+            uint32_t version;
+            uint32_t bits_per_symbol;
+            uint64_t rows;
+            uint64_t columns;
+            uint64_t row_stride;
+            uint64_t ids_offset;
+            uint64_t rows_offset;
+            uint64_t column_gaps_offset;
+            uint64_t row_bases_offset;
+            char alphabet[16];
+        };
+
+    private:
+        const char *data = nullptr;
+        size_t size = 0;
+        const Header *header = nullptr;
+        const uint64_t *id_offsets = nullptr;
+        const char *names = nullptr;
+        const uint8_t *packed_rows = nullptr;
+        const uint32_t *column_gap_counts = nullptr;
+        const uint64_t *row_base_counts = nullptr;
+        char pair_table[256][2];
+
+    public:
+        explicit AlignmentStore(const std::string &file_path);
+        ~AlignmentStore();
+
+        AlignmentStore(const AlignmentStore &) = delete;
+        AlignmentStore &operator=(const AlignmentStore &) = delete;
+
+        // Whether the file starts with the store magic
+        static bool is_store(const std::string &file_path);
+
+        // Pack a (memory-mapped) FASTA alignment into a store
+        static void import_fasta(const FastaIndex &index, const std::string &file_path);
+
+        size_t rows() const { return header->rows; }
+        size_t length(size_t) const { return header->columns; }
+        std::string_view identification(size_t row) const;
+
+        // Number of gaps in a column, and of non-gap characters in a row
+        uint32_t column_gaps(size_t column) const { return column_gap_counts[column]; }
+        uint64_t row_bases(size_t row) const { return row_base_counts[row]; }
+
+        // Append columns [start, end) of a row to out
+        void read_columns(size_t row, size_t start, size_t end, std::string &out) const;
+
+        Fasta to_fasta() const;
+    };
+
+}
@@ -0,0 +1,119 @@
+#ifndef REFINE_STAR_APPEND_H
+#define REFINE_STAR_APPEND_H
+
+#include <algorithm>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "GapRegion.h"
+#include "Garbage.h"
+#include "ProfileMerge.h"
+#include "Report.h"
+#include "Utils.h"
+
+extern std::string tmp_folder;
+
+// Add new, unaligned sequences to a previous ReAlign-Star result. Only the new rows go through
+// profileAlignment.jar and the garbage test, and only the gap regions in which a new non-garbage
+// row has bases are realigned; every other region keeps the decision of the earlier run.
+int append_sequences(const std::string &msa, const std::string &input_file, const std::string &append_file, const std::string &output_file,
+                     int window_length, int min_region_length) {
+    report.begin_stage("read");
+    utils::Fasta alignment = read_alignment(input_file);
+    utils::Fasta additions = read_from(append_file);
+    const size_t previous_count = alignment.sequences.size();
+
+    // Nothing to add: the previous result is the result
+    if (additions.identifications.empty()) {
+        logger.log(LOG_INFO, "No sequences in ", append_file, "; the input is written unchanged");
+        std::ofstream ofs(output_file);
+        alignment.write_to(ofs);
+        ofs.close();
+        return 0;
+    }
+
+    std::unordered_set<std::string> new_ids(additions.identifications.begin(), additions.identifications.end());
+    for (const auto &id : alignment.identifications) {
+        if (new_ids.count(id)) {
+            std::cerr << "** Error: sequence " << id << " is already in " << input_file << ". Please ensure that the sequence IDs are unique." << std::endl;
+            return 1;
+        }
+    }
+    for (auto &seq : additions.sequences) {
+        seq.erase(std::remove(seq.begin(), seq.end(), '-'), seq.end());
+    }
+
+    //*********** Insert the new sequences - START ***********//
+    report.begin_stage("profile merge");
+    if (!profile_aligner_available(msa)) {
+        std::cerr << "** Error: profileAlignment.jar not found in " << profile_aligner_path() << ". Please ensure it is correctly located." << std::endl;
+        return 1;
+    }
+    const std::string realigned_profile = tmp_folder + "/realigned_profile.fasta";
+    const std::string merged_file = tmp_folder + "/merged.fasta";
+    {
+        std::ofstream ofs(realigned_profile);
+        alignment.write_to(ofs);
+        ofs.close();
+    }
+    alignment = utils::Fasta();
+    merge_garbage_sequences(msa, additions.identifications, additions.sequences, realigned_profile, merged_file);
+    utils::Fasta merged = read_from(merged_file);
+    logger.log(LOG_INFO, "Appended sequences: ", additions.sequences.size(), " to ", previous_count);
+    //*********** Insert the new sequences -  END  ***********//
+
+    //*********** Classify the new sequences - START ***********//
+    report.begin_stage("garbage scan");
+    const size_t sequence_length = merged.sequences[0].size();
+    std::vector<unsigned> column_bases(sequence_length, 0);
+    for (const auto &seq : merged.sequences) {
+        for (size_t j = 0; j < sequence_length; ++j) {
+            column_bases[j] += seq[j] != '-';
+        }
+    }
+
+    std::vector<size_t> new_rows;
+    size_t garbage_count = 0;
+    for (size_t i = 0; i < merged.sequences.size(); ++i) {
+        if (!new_ids.count(merged.identifications[i])) continue;
+        if (is_lone_row(merged.sequences[i], column_bases, window_length)) {
+            ++garbage_count;
+        } else {
+            new_rows.push_back(i);
+        }
+    }
+    logger.log(LOG_INFO, "Garbage sequences among the new ones: ", garbage_count);
+    //*********** Classify the new sequences -  END  ***********//
+
+    report.begin_stage("star selection");
+    std::string star_sequence = find_star_sequence(merged.sequences);
+
+    report.begin_stage("region detection");
+    double distance = gap_region_distance(star_sequence, merged.sequences.size());
+    std::vector<std::pair<int, int>> touched_regions;
+    for (const auto &region : find_gap_regions_roughly(star_sequence, distance, min_region_length)) {
+        bool touched = std::any_of(new_rows.begin(), new_rows.end(), [&](size_t row) {
+            const std::string &seq = merged.sequences[row];
+            return std::any_of(seq.begin() + region.first, seq.begin() + region.second + 1, [](char c) { return c != '-'; });
+        });
+        if (touched) {
+            touched_regions.push_back(region);
+        }
+    }
+    logger.log(LOG_INFO, "Gap regions touched by the new sequences: ", touched_regions.size());
+
+    report.begin_stage("realignment");
+    if (!touched_regions.empty()) {
+        merged.sequences = realign_regions(msa, merged.sequences, touched_regions);
+    }
+
+    report.begin_stage("write");
+    std::ofstream ofs(output_file);
+    merged.write_to(ofs);
+    ofs.close();
+    report.end_stage();
+
+    return 0;
+}
+
+#endif //REFINE_STAR_APPEND_H
@@ -0,0 +1,112 @@
+#ifndef REFINE_STAR_APPROXIMATE_SCORE_H
+#define REFINE_STAR_APPROXIMATE_SCORE_H
+
+#include <atomic>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+#include "Report.h"
+#include "Scoring.h"
+
+// Score of each row against all the other rows, over all columns; the scores add up to twice
+// the SP score of the rows
+template <typename Scheme>
+std::vector<long long> row_scores(const std::vector<std::string> &rows) {
+    const size_t columns = rows[0].size();
+    std::vector<uint64_t> counts(columns * SCORE_CLASSES, 0);
+    count_columns<Scheme>(rows, 0, columns, counts.data());
+    std::vector<long long> scores(rows.size(), 0);
+    for (size_t i = 0; i < rows.size(); ++i) {
+        const uint64_t *column = counts.data();
+        bool previous_gap = false;
+        long long s = 0;
+        for (size_t j = 0; j < columns; ++j, column += SCORE_CLASSES) {
+            const uint8_t c = score_class<Scheme>(rows[i][j], previous_gap);
+            const long long *weights = Scheme::weights.w[c];
+            s -= weights[c];
+            for (size_t k = 0; k < SCORE_CLASSES; ++k) {
+                s += weights[k] * static_cast<long long>(column[k]);
+            }
+        }
+        scores[i] = s;
+    }
+    return scores;
+}
+
+// Accept decision of a realigned block from a sample of its rows. One row is drawn from each of
+// sample_rows strata of consecutive rows, and both versions of the block are scored on the
+// sampled rows only. The SP gain is estimated from the per-row gains (each sampled row's score
+// against the other sampled rows, after minus before, scaled up to all row pairs) with a
+// jackknife confidence interval of z standard errors; when the interval contains 0 the caller
+// scores the whole block instead.
+class ApproximateScore {
+private:
+    std::atomic<unsigned long> compared{0};
+    std::atomic<unsigned long> decided{0};
+
+public:
+    size_t sample_rows = 0;
+    double z = 3;
+
+    bool enabled() const { return sample_rows >= 3; }
+
+    // True if the sample decides between the two versions of the block; *sp_before and
+    // *sp_after then receive the estimated SP scores
+    bool compare(const std::vector<std::string> &before, const std::vector<std::string> &after, long long *sp_before, long long *sp_after) {
+        const size_t rows = before.size();
+        if (!enabled() || rows <= 2 * sample_rows) return false;
+        ++compared;
+
+        std::mt19937 generator(static_cast<unsigned>(rows * 2654435761u + before[0].size()));
+        std::vector<std::string> sampled_before(sample_rows), sampled_after(sample_rows);
+        for (size_t s = 0; s < sample_rows; ++s) {
+            const size_t first = rows * s / sample_rows;
+            const size_t last = rows * (s + 1) / sample_rows;
+            const size_t row = first + std::uniform_int_distribution<size_t>(0, last - first - 1)(generator);
+            sampled_before[s] = before[row];
+            sampled_after[s] = after[row];
+        }
+
+        const std::vector<long long> scores_after = scoring.visit([&](auto scheme) { return row_scores<decltype(scheme)>(sampled_after); });
+        const std::vector<long long> scores_before = scoring.visit([&](auto scheme) { return row_scores<decltype(scheme)>(sampled_before); });
+        const double m = static_cast<double>(sample_rows);
+        // Sampled pairs to all pairs, and the same with one sampled row left out
+        const double scale = static_cast<double>(rows) * (rows - 1) / (m * (m - 1));
+        const double scale_without_one = static_cast<double>(rows) * (rows - 1) / ((m - 1) * (m - 2));
+
+        double gain_sum = 0, before_sum = 0;
+        for (size_t s = 0; s < sample_rows; ++s) {
+            gain_sum += scores_after[s] - scores_before[s];
+            before_sum += scores_before[s];
+        }
+        const double mean = gain_sum / m;
+        double squares = 0;
+        for (size_t s = 0; s < sample_rows; ++s) {
+            const double d = scores_after[s] - scores_before[s] - mean;
+            squares += d * d;
+        }
+        // Leaving row s out removes exactly its own pairs, so the jackknife replicates differ by
+        // its gain alone
+        const double standard_error = scale_without_one * std::sqrt((m - 1) / m * squares);
+        const double gain = scale * gain_sum / 2;
+        if (standard_error == 0 || std::abs(gain) <= z * standard_error) return false;
+
+        ++decided;
+        *sp_before = std::llround(scale * before_sum / 2);
+        *sp_after = *sp_before + std::llround(gain);
+        return true;
+    }
+
+    void log_summary() {
+        if (compared == 0) return;
+        logger.log(LOG_INFO, "Approximate SP: decided ", decided.load(), " of ", compared.load(), " blocks from ",
+                   sample_rows, " sampled rows");
+        report.set_info("approx_sp_compared", std::to_string(compared.load()));
+        report.set_info("approx_sp_decided", std::to_string(decided.load()));
+    }
+};
+
+extern ApproximateScore approximate_score;
+
+#endif //REFINE_STAR_APPROXIMATE_SCORE_H
@@ -0,0 +1,167 @@
+#ifndef REFINE_STAR_CENTERSTAR_H
+#define REFINE_STAR_CENTERSTAR_H
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Prefilter.h"
+
+// Needleman-Wunsch alignment of x and y with the scores of banded_pair_score (pair_score and
+// linear gaps of the scheme's gap score), restricted to a band of radius |len(x) - len(y)| + band
+// around the diagonal; returns both rows with gaps inserted. The radius is capped at
+// max_band_radius_factor * band so that the traceback stays about len(x) * band; past the cap
+// the band follows the line from (0, 0) to (len(x), len(y)) instead of the diagonal, and each
+// row's band is widened to meet the previous one so the end stays reachable.
+constexpr size_t max_band_radius_factor = 4;
+
+std::pair<std::string, std::string> banded_align(const std::string &x, const std::string &y, size_t band) {
+    enum : char { DIAGONAL, UP, LEFT };
+    const long long gap = scoring.weights().gap();
+    const long long minus_infinity = -(1LL << 50);
+    const size_t n = x.size();
+    const size_t m = y.size();
+    const size_t difference = n > m ? n - m : m - n;
+    const bool capped = difference + band > max_band_radius_factor * band;
+    const size_t radius = capped ? max_band_radius_factor * band : std::min(difference + band, std::max(n, m));
+
+    // Columns [lo[i], hi[i]] of row i are in the band; moves[row_start[i] + j - lo[i]] is the
+    // last move of the best path to (i, j)
+    std::vector<size_t> lo(n + 1), hi(n + 1), row_start(n + 2, 0);
+    for (size_t i = 0; i <= n; ++i) {
+        const size_t center = !capped ? i : i == n ? m : i * m / n;
+        lo[i] = i == 0 || center <= radius ? 0 : std::min(center - radius, hi[i - 1]);
+        hi[i] = std::min(m, center + radius);
+        row_start[i + 1] = row_start[i] + hi[i] - lo[i] + 1;
+    }
+    std::vector<char> moves(row_start[n + 1], DIAGONAL);
+    // Cells out of the band stay at minus infinity: bands only move right, and the cell left of
+    // each row's band is reset before the row is filled
+    std::vector<long long> previous(m + 1, minus_infinity), current(m + 1, minus_infinity);
+    for (size_t j = 0; j <= hi[0]; ++j) {
+        previous[j] = gap * static_cast<long long>(j);
+        moves[j] = LEFT;
+    }
+    for (size_t i = 1; i <= n; ++i) {
+        char *row_moves = &moves[row_start[i]] - lo[i];
+        if (lo[i] == 0) {
+            current[0] = gap * static_cast<long long>(i);
+            row_moves[0] = UP;
+        } else {
+            current[lo[i] - 1] = minus_infinity;
+        }
+        for (size_t j = std::max<size_t>(lo[i], 1); j <= hi[i]; ++j) {
+            long long best = previous[j - 1] + pair_score(x[i - 1], y[j - 1]);
+            char move = DIAGONAL;
+            if (previous[j] + gap > best) {
+                best = previous[j] + gap;
+                move = UP;
+            }
+            if (current[j - 1] + gap > best) {
+                best = current[j - 1] + gap;
+                move = LEFT;
+            }
+            current[j] = best;
+            row_moves[j] = move;
+        }
+        std::swap(previous, current);
+    }
+
+    std::string aligned_x, aligned_y;
+    for (size_t i = n, j = m; i > 0 || j > 0; ) {
+        const char move = moves[row_start[i] + j - lo[i]];
+        if (move == DIAGONAL) {
+            aligned_x += x[--i];
+            aligned_y += y[--j];
+        } else if (move == UP) {
+            aligned_x += x[--i];
+            aligned_y += '-';
+        } else {
+            aligned_x += '-';
+            aligned_y += y[--j];
+        }
+    }
+    std::reverse(aligned_x.begin(), aligned_x.end());
+    std::reverse(aligned_y.begin(), aligned_y.end());
+    return {std::move(aligned_x), std::move(aligned_y)};
+}
+
+// Rows aligned among themselves, one of which (center_row) is aligned to the star of a merge
+struct AlignedGroup {
+    std::vector<std::string> rows;
+    size_t center_row = 0;
+};
+
+// Center-star merge: the center row of every group is aligned to center, and every column of
+// the group follows its center row's base to a column of center or, for a gap or an unmatched
+// base, to the insertion slot before the next column of center. Insertions of different groups
+// in the same slot share columns. Returns the rows of all groups, in order, in one alignment.
+std::vector<std::string> center_star_merge(const std::string &center, const std::vector<AlignedGroup> &groups, size_t band = 64) {
+    const size_t length = center.size();
+    // Per group and column: the column of center it lands on, or length + 1 + slot for an insertion
+    std::vector<std::vector<size_t>> placements(groups.size());
+    std::vector<size_t> slot_width(length + 1, 0);
+
+    for (size_t g = 0; g < groups.size(); ++g) {
+        const std::string &center_row = groups[g].rows[groups[g].center_row];
+        std::string ungapped = center_row;
+        ungapped.erase(std::remove(ungapped.begin(), ungapped.end(), '-'), ungapped.end());
+        const auto [aligned_center, aligned_row] = banded_align(center, ungapped, band);
+
+        // Column of center matched by each base of the center row, or length if unmatched
+        std::vector<size_t> matches;
+        matches.reserve(ungapped.size());
+        size_t p = 0;
+        for (size_t t = 0; t < aligned_center.size(); ++t) {
+            const bool center_base = aligned_center[t] != '-';
+            if (aligned_row[t] != '-') matches.push_back(center_base ? p : length);
+            if (center_base) ++p;
+        }
+
+        std::vector<size_t> &placement = placements[g];
+        std::vector<size_t> slot_use(length + 1, 0);
+        placement.reserve(center_row.size());
+        size_t next = 0;
+        size_t k = 0;
+        for (char c : center_row) {
+            const size_t match = c == '-' ? length : matches[k++];
+            if (match < length) {
+                placement.push_back(match);
+                next = match + 1;
+            } else {
+                placement.push_back(length + 1 + next);
+                ++slot_use[next];
+            }
+        }
+        for (size_t s = 0; s <= length; ++s) {
+            slot_width[s] = std::max(slot_width[s], slot_use[s]);
+        }
+    }
+
+    // Output column of every slot's first insertion and of every column of center
+    std::vector<size_t> slot_start(length + 1);
+    std::vector<size_t> center_column(length);
+    size_t width = 0;
+    for (size_t s = 0; s <= length; ++s) {
+        slot_start[s] = width;
+        width += slot_width[s];
+        if (s < length) center_column[s] = width++;
+    }
+
+    std::vector<std::string> merged;
+    for (size_t g = 0; g < groups.size(); ++g) {
+        const size_t first_row = merged.size();
+        merged.resize(first_row + groups[g].rows.size(), std::string(width, '-'));
+        std::vector<size_t> slot_use(length + 1, 0);
+        for (size_t col = 0; col < placements[g].size(); ++col) {
+            const size_t place = placements[g][col];
+            const size_t out = place < length ? center_column[place] : slot_start[place - length - 1] + slot_use[place - length - 1]++;
+            for (size_t r = 0; r < groups[g].rows.size(); ++r) {
+                merged[first_row + r][out] = groups[g].rows[r][col];
+            }
+        }
+    }
+    return merged;
+}
+
+#endif //REFINE_STAR_CENTERSTAR_H
@@ -0,0 +1,190 @@
+#ifndef REFINE_STAR_CHECKPOINT_H
+#define REFINE_STAR_CHECKPOINT_H
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "GapRegion.h"
+#include "Report.h"
+
+// 64-bit FNV-1a, continued from hash
+uint64_t fnv1a(const char *data, size_t size, uint64_t hash = 14695981039346656037ULL) {
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+uint64_t fnv1a_file(const std::string &file_path) {
+    std::ifstream ifs(file_path, std::ios::binary);
+    std::vector<char> buffer(1 << 20);
+    uint64_t hash = 14695981039346656037ULL;
+    while (ifs.read(buffer.data(), buffer.size()) || ifs.gcount() > 0) {
+        hash = fnv1a(buffer.data(), ifs.gcount(), hash);
+    }
+    return hash;
+}
+
+// Completed work of a run, kept in a directory so that a preempted run can resume. Every
+// realigned block and, at most every merge_interval seconds, the profile with the garbage
+// sequences inserted so far are written to their own file, then recorded in an append-only
+// manifest with their FNV-1a checksum. The manifest starts with the checksum of the input and
+// the run parameters; entries of another input or parameters, and files whose checksum does
+// not match (e.g. cut short by the preemption), are ignored on resume.
+class Checkpoint {
+private:
+    static constexpr const char *format = "realign_star checkpoint 1";
+
+    std::string directory;
+    std::string identity;
+    std::ofstream manifest;
+    std::mutex mutex;
+    size_t merged_count = 0;
+    std::string merged_file;
+    std::chrono::steady_clock::time_point last_merge_save;
+
+    void record(const std::string &line) {
+        manifest << line << '\n';
+        manifest.flush();
+    }
+
+    // Write content to name in the directory through a rename, and return its checksum
+    uint64_t write_file(const std::string &name, const std::string &content) {
+        const std::string path = directory + "/" + name;
+        {
+            std::ofstream ofs(path + ".part", std::ios::binary);
+            ofs.write(content.data(), content.size());
+        }
+        std::filesystem::rename(path + ".part", path);
+        return fnv1a(content.data(), content.size());
+    }
+
+    bool valid_file(const std::string &name, uint64_t checksum) const {
+        return std::filesystem::exists(directory + "/" + name) && fnv1a_file(directory + "/" + name) == checksum;
+    }
+
+public:
+    BlockCache blocks;
+    double merge_interval = 60;
+
+    bool enabled() const { return !directory.empty(); }
+
+    // Use dir for checkpoints of a run on input_file with the given parameters; with resume,
+    // the valid entries already there are loaded first
+    bool open(const std::string &dir, const std::string &input_file, const std::string &parameters, bool resume) {
+        directory = dir;
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+        identity = "input " + std::to_string(fnv1a_file(input_file)) + " " + parameters;
+        const std::string manifest_path = directory + "/manifest";
+
+        size_t resumed_blocks = 0;
+        std::vector<std::string> kept;
+        std::ifstream previous(manifest_path);
+        std::string line;
+        if (resume && std::getline(previous, line) && line == format && std::getline(previous, line) && line == identity) {
+            while (std::getline(previous, line)) {
+                std::istringstream fields(line);
+                std::string kind, scope, name;
+                uint64_t checksum;
+                fields >> kind;
+                if (kind == "block") {
+                    int start, end;
+                    long long gain;
+                    fields >> scope >> start >> end >> gain >> checksum >> name;
+                    if (!fields || !valid_file(name, checksum)) continue;
+                    std::vector<std::string> rows;
+                    std::ifstream ifs(directory + "/" + name, std::ios::binary);
+                    std::string row;
+                    while (std::getline(ifs, row)) rows.push_back(std::move(row));
+                    blocks.blocks[std::make_tuple(scope, start, end)] = std::make_pair(std::move(rows), gain);
+                    ++resumed_blocks;
+                } else if (kind == "merged") {
+                    size_t count;
+                    fields >> count >> checksum >> name;
+                    if (!fields || !valid_file(name, checksum)) continue;
+                    merged_count = count;
+                    merged_file = name;
+                } else {
+                    continue;
+                }
+                kept.push_back(line);
+            }
+        }
+        previous.close();
+
+        // Rewrite the manifest with only the entries that are still valid, through a rename so
+        // that a preemption while rewriting leaves the old manifest whole; appends then go to it
+        {
+            std::ofstream rewritten(manifest_path + ".part", std::ios::trunc);
+            rewritten << format << '\n' << identity << '\n';
+            for (const auto &entry : kept) rewritten << entry << '\n';
+            rewritten.close();
+            if (rewritten) std::filesystem::rename(manifest_path + ".part", manifest_path, error);
+            if (!rewritten || error) {
+                std::cerr << "** Error: cannot write checkpoints to " << directory << "." << std::endl;
+                return false;
+            }
+        }
+        manifest.open(manifest_path, std::ios::app);
+        if (!manifest) {
+            std::cerr << "** Error: cannot write checkpoints to " << directory << "." << std::endl;
+            return false;
+        }
+        if (resume) {
+            logger.log(LOG_INFO, "Resumed from ", directory, ": ", resumed_blocks, " blocks, ", merged_count, " garbage sequences inserted");
+        }
+
+        blocks.persist = [this](const std::tuple<std::string, int, int> &key, const std::vector<std::string> &rows, long long gain) {
+            save_block(key, rows, gain);
+        };
+        last_merge_save = std::chrono::steady_clock::now();
+        return true;
+    }
+
+    void save_block(const std::tuple<std::string, int, int> &key, const std::vector<std::string> &rows, long long gain) {
+        const auto &[scope, start, end] = key;
+        std::string content;
+        for (const auto &row : rows) {
+            content += row;
+            content += '\n';
+        }
+        const std::string name = "block_" + scope + "_" + std::to_string(start) + "_" + std::to_string(end) + ".txt";
+        std::lock_guard<std::mutex> lock(mutex);
+        const uint64_t checksum = write_file(name, content);
+        record("block " + scope + " " + std::to_string(start) + " " + std::to_string(end) + " " + std::to_string(gain) + " " + std::to_string(checksum) + " " + name);
+    }
+
+    // Number of garbage sequences already in the checkpointed profile, which is copied over
+    // realigned_profile; 0 if there is none
+    size_t resume_merge(const std::string &realigned_profile) {
+        if (merged_count == 0) return 0;
+        std::filesystem::copy_file(directory + "/" + merged_file, realigned_profile, std::filesystem::copy_options::overwrite_existing);
+        return merged_count;
+    }
+
+    // Keep realigned_profile with count garbage sequences inserted, unless the last one is too recent
+    void save_merge(size_t count, const std::string &realigned_profile, bool force) {
+        if (!force && Report::seconds_since(last_merge_save) < merge_interval) return;
+        std::ifstream ifs(realigned_profile, std::ios::binary);
+        std::ostringstream content;
+        content << ifs.rdbuf();
+        std::lock_guard<std::mutex> lock(mutex);
+        const std::string name = "merged_" + std::to_string(count) + ".fasta";
+        const uint64_t checksum = write_file(name, content.str());
+        record("merged " + std::to_string(count) + " " + std::to_string(checksum) + " " + name);
+        if (!merged_file.empty() && merged_file != name) {
+            std::filesystem::remove(directory + "/" + merged_file);
+        }
+        merged_count = count;
+        merged_file = name;
+        last_merge_save = std::chrono::steady_clock::now();
+    }
+};
+
+#endif //REFINE_STAR_CHECKPOINT_H
@@ -0,0 +1,249 @@
+#ifndef REFINE_STAR_CHUNKED_H
+#define REFINE_STAR_CHUNKED_H
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#include <set>
+#include <string>
+#include <vector>
+#include "FastaIndex.h"
+#include "AlignmentStore.h"
+#include "GapRegion.h"
+#include "Garbage.h"
+#include "ProfileMerge.h"
+#include "Report.h"
+
+extern std::string tmp_folder;
+
+// Columns [start, end) of the given rows, read through the index (a FastaIndex or an AlignmentStore)
+template<typename Source>
+std::vector<std::string> read_window(const Source &index, const std::vector<size_t> &rows, size_t start, size_t end) {
+    std::vector<std::string> window(rows.size());
+    for (size_t i = 0; i < rows.size(); ++i) {
+        index.read_columns(rows[i], start, end, window[i]);
+    }
+    return window;
+}
+
+// Profile columns [start, end) of the given rows; kept_columns maps profile columns to input columns
+template<typename Source>
+std::vector<std::string> read_profile_window(const Source &index, const std::vector<size_t> &rows, const std::vector<size_t> &kept_columns, size_t start, size_t end) {
+    const size_t input_start = kept_columns[start];
+    const size_t input_end = kept_columns[end - 1] + 1;
+    std::vector<std::string> window = read_window(index, rows, input_start, input_end);
+    if (input_end - input_start == end - start) {
+        return window;
+    }
+
+    for (auto &seq : window) {
+        std::string kept;
+        kept.reserve(end - start);
+        for (size_t j = start; j < end; ++j) {
+            kept += seq[kept_columns[j] - input_start];
+        }
+        seq = std::move(kept);
+    }
+    return window;
+}
+
+// Split [0, width) into windows of about chunk_columns columns without cutting through a gap region
+std::vector<std::pair<size_t, size_t>> plan_windows(size_t width, size_t chunk_columns, const std::vector<std::pair<int, int>> &gap_regions) {
+    std::vector<std::pair<size_t, size_t>> windows;
+    size_t start = 0;
+    size_t r = 0;
+    while (start < width) {
+        size_t end = std::min(width, start + chunk_columns);
+        while (r < gap_regions.size() && static_cast<size_t>(gap_regions[r].second) < end) {
+            ++r;
+        }
+        if (r < gap_regions.size() && static_cast<size_t>(gap_regions[r].first) < end) {
+            if (static_cast<size_t>(gap_regions[r].first) > start) {
+                end = gap_regions[r].first;
+            } else {
+                end = gap_regions[r].second + 1;
+            }
+        }
+        windows.emplace_back(start, end);
+        start = end;
+    }
+    return windows;
+}
+
+// Realign the alignment in column windows read from a memory-mapped input, so that memory is
+// bounded by rows x chunk_columns instead of the whole alignment. Each realigned window is
+// spooled to the scratch folder and the rows are stitched together one at a time at the end.
+template<typename Source>
+int realign_chunked(const Source &index, const std::string &msa, const std::string &input_file, const std::string &output_file,
+                    int window_length, int min_region_length, size_t chunk_columns) {
+    const size_t sequence_count = index.rows();
+    const size_t width = sequence_count ? index.length(0) : 0;
+    for (size_t i = 0; i < sequence_count; ++i) {
+        if (index.length(i) != width) {
+            std::cerr << "** Error: sequences in " << input_file << " are not of equal length." << std::endl;
+            return 1;
+        }
+    }
+    if (width == 0) {
+        std::cerr << "** Error: no sequences in " << input_file << "." << std::endl;
+        return 1;
+    }
+
+    //*********** Find garbage sequences - START ***********//
+    report.begin_stage("garbage scan");
+    std::vector<size_t> all_rows(sequence_count);
+    std::iota(all_rows.begin(), all_rows.end(), 0);
+    std::vector<size_t> base_counts(sequence_count, 0);
+    std::set<size_t> garbage_index;
+
+    for (size_t start = 0; start < width; start += chunk_columns) {
+        const size_t end = std::min(width, start + chunk_columns);
+        // Overlap the next window so that every sliding window start in [start, end) is scanned
+        auto window = read_window(index, all_rows, start, std::min(width, end + window_length - 1));
+        for (size_t garbage : scan_sequences(window, window_length)) {
+            garbage_index.insert(garbage);
+        }
+        for (size_t i = 0; i < sequence_count; ++i) {
+            base_counts[i] += std::count_if(window[i].begin(), window[i].begin() + (end - start), [](char c) { return c != '-'; });
+        }
+    }
+
+    std::vector<size_t> profile_rows;
+    std::vector<size_t> garbage_rows;
+    for (size_t i = 0; i < sequence_count; ++i) {
+        (garbage_index.count(i) ? garbage_rows : profile_rows).push_back(i);
+    }
+
+    // Input columns kept in the profile: those where some profile row has a base
+    std::vector<size_t> kept_columns;
+    kept_columns.reserve(width);
+    for (size_t start = 0; start < width; start += chunk_columns) {
+        const size_t end = std::min(width, start + chunk_columns);
+        if (garbage_rows.empty()) {
+            for (size_t j = start; j < end; ++j) kept_columns.push_back(j);
+            continue;
+        }
+        auto window = read_window(index, profile_rows, start, end);
+        for (size_t j = 0; j < end - start; ++j) {
+            for (const auto &seq : window) {
+                if (seq[j] != '-') {
+                    kept_columns.push_back(start + j);
+                    break;
+                }
+            }
+        }
+    }
+    logger.log(LOG_INFO, "Garbage sequences: ", garbage_rows.size());
+    //*********** Find garbage sequences -  END  ***********//
+
+    report.begin_stage("star selection");
+    // As in the in-memory path, there is no star when every row is garbage: no region is found
+    // and the rows go through to the profile merge as they are
+    std::string star_sequence;
+    if (!profile_rows.empty()) {
+        size_t star_row = profile_rows[0];
+        for (size_t row : profile_rows) {
+            if (base_counts[row] > base_counts[star_row]) star_row = row;
+        }
+        star_sequence = read_profile_window(index, {star_row}, kept_columns, 0, kept_columns.size())[0];
+    }
+    logger.log(LOG_DEBUG, "star sequence: ", star_sequence);
+
+    report.begin_stage("region detection");
+    double distance = gap_region_distance(star_sequence, sequence_count);
+    std::vector<std::pair<int, int>> gap_regions = find_gap_regions_roughly(star_sequence, distance, min_region_length);
+    std::string().swap(star_sequence);
+
+    //*********** Realign window by window - START ***********//
+    report.begin_stage("realignment");
+    auto windows = plan_windows(kept_columns.size(), chunk_columns, gap_regions);
+    logger.log(LOG_INFO, "Windows: ", windows.size(), ", gap regions: ", gap_regions.size());
+
+    std::vector<std::string> spool_files;
+    std::vector<size_t> spool_widths;
+    size_t r = 0;
+    for (const auto &[start, end] : windows) {
+        std::vector<std::pair<int, int>> local_regions;
+        for (; r < gap_regions.size() && static_cast<size_t>(gap_regions[r].second) < end; ++r) {
+            local_regions.emplace_back(gap_regions[r].first - start, gap_regions[r].second - start);
+        }
+
+        auto window = read_profile_window(index, profile_rows, kept_columns, start, end);
+        if (!local_regions.empty()) {
+            window = realign_regions(msa, window, local_regions);
+        }
+
+        // Rows of one window have the same width, so row i sits at i * (width + 1)
+        spool_files.push_back(tmp_folder + "/window_" + std::to_string(spool_files.size()) + ".txt");
+        spool_widths.push_back(window[0].size());
+        std::ofstream spool(spool_files.back(), std::ios::binary);
+        for (const auto &seq : window) {
+            spool << seq << '\n';
+        }
+        spool.close();
+    }
+    //*********** Realign window by window -  END  ***********//
+
+    report.begin_stage(garbage_rows.empty() ? "write" : "profile merge");
+    const std::string realigned_profile = tmp_folder + "/realigned_profile.fasta";
+    {
+        std::ofstream ofs(garbage_rows.empty() ? output_file : realigned_profile);
+        std::vector<std::ifstream> spools;
+        for (const auto &file : spool_files) {
+            spools.emplace_back(file, std::ios::binary);
+        }
+
+        std::string row;
+        for (size_t i = 0; i < profile_rows.size(); ++i) {
+            row.clear();
+            for (size_t k = 0; k < spools.size(); ++k) {
+                const size_t offset = row.size();
+                row.resize(offset + spool_widths[k]);
+                spools[k].seekg(i * (spool_widths[k] + 1));
+                spools[k].read(&row[offset], spool_widths[k]);
+            }
+            ofs << '>' << index.identification(profile_rows[i]) << '\n';
+            utils::Fasta::cut_and_write(ofs, row);
+            if (i != profile_rows.size() - 1) ofs << '\n';
+        }
+        ofs.close();
+    }
+    for (const auto &file : spool_files) {
+        std::filesystem::remove(file);
+    }
+
+    if (!garbage_rows.empty()) {
+        if (!profile_aligner_available(msa)) {
+            std::cerr << "** Error: profileAlignment.jar not found in " << profile_aligner_path() << ". Please ensure it is correctly located." << std::endl;
+            return 1;
+        }
+
+        std::vector<std::string> garbage_identifications;
+        std::vector<std::string> garbage_sequences;
+        for (size_t row : garbage_rows) {
+            garbage_identifications.emplace_back(index.identification(row));
+            std::string sequence;
+            index.read_columns(row, 0, width, sequence);
+            sequence.erase(std::remove(sequence.begin(), sequence.end(), '-'), sequence.end());
+            garbage_sequences.push_back(std::move(sequence));
+        }
+        merge_garbage_sequences(msa, garbage_identifications, garbage_sequences, realigned_profile, output_file);
+    }
+    report.end_stage();
+
+    return 0;
+}
+
+int realign_chunked(const std::string &msa, const std::string &input_file, const std::string &output_file,
+                    int window_length, int min_region_length, size_t chunk_columns) {
+    report.begin_stage("read");
+    if (utils::AlignmentStore::is_store(input_file)) {
+        utils::AlignmentStore store(input_file);
+        return realign_chunked(store, msa, input_file, output_file, window_length, min_region_length, chunk_columns);
+    }
+    utils::FastaIndex index(input_file);
+    return realign_chunked(index, msa, input_file, output_file, window_length, min_region_length, chunk_columns);
+}
+
+#endif //REFINE_STAR_CHUNKED_H
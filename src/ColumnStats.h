@@ -0,0 +1,107 @@
+#ifndef REFINE_STAR_COLUMN_STATS_H
+#define REFINE_STAR_COLUMN_STATS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Scoring.h"
+
+// Per-column statistics of an alignment, from the column counts of the scoring kernel: rows are
+// counted into SCORE_CLASSES counts per column, one row at a time (so a file can be streamed
+// through without holding its rows), and each column's gap fraction, entropy and SP score under
+// the selected scheme are derived from its counts alone. Counting is a pass of its own over the
+// rows; the pipeline's scoring does not produce it.
+class ColumnStats {
+private:
+    std::vector<uint64_t> counts;
+    size_t columns = 0;
+    size_t rows = 0;
+
+public:
+    void add_row(std::string_view row) {
+        if (rows == 0) {
+            columns = row.size();
+            counts.assign(columns * SCORE_CLASSES, 0);
+        }
+        ++rows;
+        const size_t length = std::min(row.size(), columns);
+        scoring.visit([&](auto scheme) {
+            uint64_t *column = counts.data();
+            bool previous_gap = false;
+            for (size_t j = 0; j < length; ++j, column += SCORE_CLASSES) {
+                ++column[score_class<decltype(scheme)>(row[j], previous_gap)];
+            }
+            return 0;
+        });
+    }
+
+    void add_rows(const std::vector<std::string> &sequences) {
+        for (const auto &row : sequences) {
+            add_row(row);
+        }
+    }
+
+    // Rows of a FASTA alignment, streamed one record at a time; lines may have any width
+    void add_rows(std::istream &is) {
+        std::string line, row;
+        bool in_record = false;
+        while (std::getline(is, line)) {
+            if (line.empty()) continue;
+            if (line[0] == '>') {
+                if (in_record) add_row(row);
+                row.clear();
+                in_record = true;
+            } else if (in_record) {
+                row += line;
+            }
+        }
+        if (in_record) add_row(row);
+    }
+
+    // SP score of a column, the sum of which is the SP score of the alignment
+    long long column_score(size_t column) const {
+        return scoring.visit([&](auto scheme) { return score_counts<decltype(scheme)>(&counts[column * SCORE_CLASSES]); });
+    }
+
+    // Shannon entropy, in bits, of the non-gap symbols of a column (N and other symbols as one)
+    double column_entropy(size_t column) const {
+        const uint64_t *c = &counts[column * SCORE_CLASSES];
+        const uint64_t symbols = c[SYMBOL_A] + c[SYMBOL_C] + c[SYMBOL_G] + c[SYMBOL_T] + c[SYMBOL_N];
+        double entropy = 0;
+        for (size_t s = SYMBOL_A; s <= SYMBOL_N; ++s) {
+            if (c[s] == 0) continue;
+            const double p = static_cast<double>(c[s]) / symbols;
+            entropy -= p * std::log2(p);
+        }
+        return entropy;
+    }
+
+    uint64_t column_gaps(size_t column) const {
+        return counts[column * SCORE_CLASSES + SYMBOL_GAP] + counts[column * SCORE_CLASSES + SCORE_GAP_OPEN];
+    }
+
+    // Write one tab-separated line per column, labelled with the alignment's name; returns the
+    // SP score of the alignment
+    long long write_tsv(std::ostream &os, const std::string &label) const {
+        long long total = 0;
+        for (size_t j = 0; j < columns; ++j) {
+            const long long sp = column_score(j);
+            total += sp;
+            const uint64_t gaps = column_gaps(j);
+            os << label << '\t' << j << '\t' << rows << '\t' << gaps << '\t' << static_cast<double>(gaps) / rows
+               << '\t' << column_entropy(j) << '\t' << sp << '\n';
+        }
+        return total;
+    }
+
+    static void write_header(std::ostream &os) {
+        os << "alignment\tcolumn\trows\tgaps\tgap_fraction\tentropy\tsp\n";
+    }
+};
+
+#endif //REFINE_STAR_COLUMN_STATS_H
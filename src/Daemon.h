@@ -0,0 +1,295 @@
+#ifndef REFINE_STAR_DAEMON_H
+#define REFINE_STAR_DAEMON_H
+
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "FastaIndex.h"
+#include "AlignmentStore.h"
+#include "GapIndex.h"
+#include "GapRegion.h"
+#include "Pipeline.h"
+#include "ProfileMerge.h"
+#include "Remote.h"
+#include "Report.h"
+#include "Utils.h"
+
+extern std::string tmp_folder;
+
+// State a daemon keeps between requests: the parsed alignment and its gap index, the garbage
+// rows of every garbage scan, the profile of the last one, and every realigned block
+struct DaemonState {
+    utils::Fasta alignment;
+    std::optional<utils::GapIndex> gap_index;
+    std::map<std::pair<int, double>, std::unordered_set<size_t>> garbage_rows;
+    std::pair<int, double> profile_key = {-1, 0};
+    std::optional<utils::GapIndex> profile_index;
+    std::vector<std::string> profile_identifications;
+    std::vector<std::string> profile_sequences;
+    std::vector<std::string> garbage_identifications;
+    std::vector<std::string> garbage_sequences;
+    BlockCache cache;
+    std::string last_result;
+    unsigned long requests = 0;
+};
+
+// Parse "key=value" words after the command
+std::map<std::string, std::string> parse_request(std::istringstream &words) {
+    std::map<std::string, std::string> values;
+    std::string word;
+    while (words >> word) {
+        const size_t equal = word.find('=');
+        if (equal == std::string::npos) {
+            values[word] = "";
+        } else {
+            values[word.substr(0, equal)] = word.substr(equal + 1);
+        }
+    }
+    return values;
+}
+
+// Read values[key] into value if it is there; false if it is not a number within [min, max]
+template <typename T>
+bool request_number(const std::map<std::string, std::string> &values, const std::string &key, T min, T max, T &value) {
+    const auto found = values.find(key);
+    if (found == values.end()) return true;
+    const char *text = found->second.c_str();
+    char *end = nullptr;
+    errno = 0;
+    if constexpr (std::is_integral_v<T>) {
+        const long long parsed = strtoll(text, &end, 10);
+        if (end == text || *end != '\0' || errno == ERANGE || parsed < static_cast<long long>(min) || parsed > static_cast<long long>(max)) return false;
+        value = static_cast<T>(parsed);
+    } else {
+        const double parsed = strtod(text, &end);
+        if (end == text || *end != '\0' || errno == ERANGE || !(parsed >= min && parsed <= max)) return false;
+        value = parsed;
+    }
+    return true;
+}
+
+// Write a FASTA result to output_file, packing it when the name ends with ".ras"
+void export_result(const std::string &fasta_file, const std::string &output_file) {
+    if (is_store_path(output_file)) {
+        utils::AlignmentStore::import_fasta(utils::FastaIndex(fasta_file), output_file);
+    } else {
+        std::filesystem::copy_file(fasta_file, output_file, std::filesystem::copy_options::overwrite_existing);
+    }
+}
+
+// realign [w=..] [l=..] [m=..] [iter=..] [min_gain=..] [sample=..] [divergent=..] [garbage_cluster=..] [o=..]:
+// the steps of a normal run, with the daemon's options where a value is not given. The garbage
+// scan and profile are reused while w and divergent are unchanged, and every block realigned before.
+std::string daemon_realign(DaemonState &state, std::map<std::string, std::string> values, const PipelineOptions &defaults) {
+    PipelineOptions options = defaults;
+    const int columns = static_cast<int>(std::min<size_t>(state.gap_index->columns(), INT_MAX));
+    if (!request_number(values, "w", 1, columns, options.window_length)) return "ERROR w must be a number from 1 to " + std::to_string(columns);
+    if (!request_number(values, "l", 1, columns, options.min_region_length)) return "ERROR l must be a number from 1 to " + std::to_string(columns);
+    if (!request_number(values, "iter", 0, INT_MAX, options.iterations)) return "ERROR iter must be a number of passes, 0 for no limit";
+    if (!request_number(values, "min_gain", LLONG_MIN, LLONG_MAX, options.min_gain)) return "ERROR min_gain must be a number";
+    if (!request_number<size_t>(values, "sample", 0, state.alignment.sequences.size(), options.sample_rows)) return "ERROR sample must be a number of rows";
+    if (!request_number(values, "divergent", 0.0, 1.0, options.max_divergence)) return "ERROR divergent must be a distance from 0 to 1";
+    if (!request_number(values, "garbage_cluster", 0.0, 1.0, options.garbage_cluster_distance)) return "ERROR garbage_cluster must be a distance from 0 to 1";
+    if (values.count("m")) options.msa = values["m"];
+    if (!is_supported_msa(options.msa)) {
+        return "ERROR unsupported msa " + options.msa;
+    }
+    auto start = std::chrono::steady_clock::now();
+
+    const std::pair<int, double> garbage_key = {options.window_length, options.max_divergence};
+    auto found = state.garbage_rows.find(garbage_key);
+    if (found == state.garbage_rows.end()) {
+        found = state.garbage_rows.emplace(garbage_key, find_garbage_rows(options, *state.gap_index, state.alignment.sequences)).first;
+    }
+    const std::unordered_set<size_t> &garbage = found->second;
+
+    if (state.profile_key != garbage_key) {
+        state.profile_identifications.clear();
+        state.profile_sequences.clear();
+        state.garbage_identifications.clear();
+        state.garbage_sequences.clear();
+        for (size_t i = 0; i < state.alignment.sequences.size(); ++i) {
+            (garbage.count(i) ? state.garbage_identifications : state.profile_identifications).push_back(state.alignment.identifications[i]);
+        }
+        state.profile_index = state.gap_index;
+        split_garbage(std::vector<std::string>(state.alignment.sequences), garbage, *state.profile_index, state.profile_sequences, state.garbage_sequences);
+        state.profile_key = garbage_key;
+    }
+
+    const unsigned long hits_before = state.cache.hits;
+    std::ostringstream scope;
+    scope << options.msa << " w=" << options.window_length << " divergent=" << options.max_divergence << " l=" << options.min_region_length
+          << " sample=" << options.sample_rows << " ";
+    utils::Fasta profile;
+    profile.identifications = state.profile_identifications;
+    profile.sequences = state.profile_sequences;
+    const size_t regions = realign_profile(options, profile.sequences, *state.profile_index, state.alignment.sequences.size(), &state.cache, scope.str());
+    report.end_stage();
+
+    const std::string result = tmp_folder + "/result_" + std::to_string(state.requests) + ".fasta";
+    if (garbage.empty()) {
+        std::ofstream ofs(result);
+        profile.write_to(ofs);
+        ofs.close();
+    } else {
+        if (!profile_aligner_available(options.msa)) {
+            return "ERROR profileAlignment.jar not found in " + profile_aligner_path();
+        }
+        const std::string realigned_profile = tmp_folder + "/realigned_profile.fasta";
+        std::ofstream ofs(realigned_profile);
+        profile.write_to(ofs);
+        ofs.close();
+        merge_garbage(options, state.garbage_identifications, state.garbage_sequences, realigned_profile, result);
+    }
+    if (!state.last_result.empty() && state.last_result != result) {
+        std::filesystem::remove(state.last_result);
+    }
+    state.last_result = result;
+    if (values.count("o")) {
+        export_result(result, values["o"]);
+    }
+
+    std::ostringstream reply;
+    reply << "OK garbage=" << garbage.size() << " regions=" << regions << " cached=" << state.cache.hits - hits_before
+          << " seconds=" << Report::seconds_since(start);
+    if (values.count("o")) reply << " output=" << values["o"];
+    return reply.str();
+}
+
+std::string daemon_stats(const DaemonState &state) {
+    std::ostringstream reply;
+    reply << "OK rows=" << state.alignment.sequences.size() << " columns=" << state.gap_index->columns()
+          << " requests=" << state.requests << " garbage_scans=" << state.garbage_rows.size()
+          << " cached_blocks=" << state.cache.blocks.size() << " cache_hits=" << state.cache.hits << " cache_misses=" << state.cache.misses;
+    return reply.str();
+}
+
+// Serve requests on a Unix domain socket, one line per request and one line per reply:
+//   realign [w=<window>] [l=<length>] [m=<msa>] [iter=<passes>] [min_gain=<sp>] [sample=<rows>]
+//           [divergent=<distance>] [garbage_cluster=<distance>] [o=<output>]
+//   export o=<output>
+//   stats
+//   shutdown
+int serve_daemon(const std::string &socket_path, const std::string &input_file, const PipelineOptions &defaults) {
+    DaemonState state;
+    report.begin_stage("read");
+    state.alignment = read_alignment(input_file);
+    if (state.alignment.sequences.empty()) {
+        std::cerr << "** Error: no sequences in " << input_file << "." << std::endl;
+        return 1;
+    }
+    state.gap_index.emplace(state.alignment.sequences);
+    report.end_stage();
+
+    struct sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "** Error: socket path " << socket_path << " is too long." << std::endl;
+        return 1;
+    }
+    strcpy(address.sun_path, socket_path.c_str());
+    unlink(socket_path.c_str());
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 || bind(listener, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) != 0 || listen(listener, 16) != 0) {
+        std::cerr << "** Error: cannot listen on " << socket_path << "." << std::endl;
+        return 1;
+    }
+    struct sigaction action = {};
+    action.sa_handler = [](int) { stop_requested = 1; };
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    logger.log(LOG_INFO, "Daemon serving ", input_file, " on ", socket_path);
+    logger.flush();
+
+    bool running = true;
+    while (running && !stop_requested) {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        std::string buffer;
+        char chunk[4096];
+        ssize_t got;
+        while (running && (got = recv(fd, chunk, sizeof(chunk), 0)) > 0) {
+            buffer.append(chunk, got);
+            size_t line_end;
+            while (running && (line_end = buffer.find('\n')) != std::string::npos) {
+                std::istringstream words(buffer.substr(0, line_end));
+                buffer.erase(0, line_end + 1);
+                std::string command;
+                words >> command;
+                auto values = parse_request(words);
+
+                std::string reply;
+                if (command == "realign") {
+                    reply = daemon_realign(state, values, defaults);
+                } else if (command == "export") {
+                    if (state.last_result.empty() || !values.count("o")) {
+                        reply = "ERROR nothing to export, or no o=<output>";
+                    } else {
+                        export_result(state.last_result, values["o"]);
+                        reply = "OK output=" + values["o"];
+                    }
+                } else if (command == "stats") {
+                    reply = daemon_stats(state);
+                } else if (command == "shutdown") {
+                    reply = "OK shutting down";
+                    running = false;
+                } else if (!command.empty()) {
+                    reply = "ERROR unknown command " + command;
+                }
+                if (reply.empty()) continue;
+                ++state.requests;
+                logger.log(LOG_INFO, command, ": ", reply);
+                logger.flush();
+                reply += '\n';
+                write_all(fd, reply.data(), reply.size());
+            }
+        }
+        close(fd);
+    }
+
+    close(listener);
+    unlink(socket_path.c_str());
+    return 0;
+}
+
+// Send one request line to a daemon and print its reply; 0 if the daemon answered OK
+int send_daemon_request(const std::string &socket_path, const std::string &request) {
+    struct sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) != 0) {
+        std::cerr << "** Error: no daemon on " << socket_path << "." << std::endl;
+        return 1;
+    }
+    const std::string line = request + "\n";
+    write_all(fd, line.data(), line.size());
+    shutdown(fd, SHUT_WR);
+
+    std::string reply;
+    char chunk[4096];
+    ssize_t got;
+    while ((got = recv(fd, chunk, sizeof(chunk), 0)) > 0) {
+        reply.append(chunk, got);
+    }
+    close(fd);
+    std::cout << reply;
+    return reply.compare(0, 2, "OK") == 0 ? 0 : 1;
+}
+
+#endif //REFINE_STAR_DAEMON_H
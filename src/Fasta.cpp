@@ -61,23 +61,16 @@ void utils::Fasta::_read(std::istream &is)
 
 void utils::Fasta::cut_and_write(std::ostream &os, const std::string &sequence)
 {
+    // Written line by line straight from the sequence, without a cut copy
     const size_t sequence_length = sequence.size();
-
-    char *cut_sequence = new char[sequence_length + sequence_length / max_line_length + 1];
-    size_t des_index = 0;
     for (size_t src_index = 0; src_index < sequence_length; src_index += max_line_length)
     {
-        if (src_index) cut_sequence[des_index++] = '\n';
+        if (src_index) os.put('\n');
 
         size_t write_length = sequence_length - src_index;
         if (write_length > max_line_length) write_length = max_line_length;
 
-        memcpy(cut_sequence + des_index, sequence.data() + src_index, write_length);
-        des_index += write_length;
+        os.write(sequence.data() + src_index, write_length);
     }
-    cut_sequence[des_index] = 0;
-
-    os << cut_sequence;
-    delete[] cut_sequence;
 }
 
@@ -0,0 +1,106 @@
+#include "FastaIndex.h"
+
+#include <algorithm>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+utils::FastaIndex::FastaIndex(const std::string &file_path)
+{
+    int fd = open(file_path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        std::cerr << "Error: cannot open file " << file_path << std::endl;
+        std::cerr << "Please check that the file path is correct and make sure the file exists." << std::endl;
+        exit(1);
+    }
+    size = st.st_size;
+    if (size) {
+        void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED) {
+            std::cerr << "Error: cannot map file " << file_path << std::endl;
+            exit(1);
+        }
+        data = static_cast<const char *>(mapped);
+        madvise(mapped, size, MADV_RANDOM);
+    }
+    close(fd);
+
+    _index();
+}
+
+utils::FastaIndex::~FastaIndex()
+{
+    if (data) munmap(const_cast<char *>(data), size);
+}
+
+void utils::FastaIndex::_index()
+{
+    size_t pos = 0;
+    while (pos < size)
+    {
+        size_t line_end = pos;
+        while (line_end < size && data[line_end] != '\n') ++line_end;
+
+        if (data[pos] == '>')
+        {
+            Record record{pos + 1, line_end - pos - 1, line_end + 1, 0, 0, 0};
+            if (record.id_length && data[line_end - 1] == '\r') --record.id_length;
+            records.push_back(record);
+        }
+        else if (!records.empty() && line_end > pos)
+        {
+            Record &record = records.back();
+            size_t bases = line_end - pos;
+            size_t bytes = bases + (line_end < size ? 1 : 0);
+            if (data[line_end - 1] == '\r') --bases;
+
+            // A short line may only be the last line of its record
+            if (record.line_bases && record.length % record.line_bases != 0)
+            {
+                std::cerr << "Error: irregular line lengths in sequence "
+                          << std::string(data + record.id_offset, record.id_length) << std::endl;
+                std::cerr << "Please rewrite the file with a fixed line width to use the chunked mode." << std::endl;
+                exit(1);
+            }
+            if (!record.line_bases)
+            {
+                record.line_bases = bases;
+                record.line_bytes = bytes;
+            }
+            else if (bases > record.line_bases)
+            {
+                std::cerr << "Error: irregular line lengths in sequence "
+                          << std::string(data + record.id_offset, record.id_length) << std::endl;
+                std::cerr << "Please rewrite the file with a fixed line width to use the chunked mode." << std::endl;
+                exit(1);
+            }
+            record.length += bases;
+        }
+        pos = line_end + 1;
+    }
+}
+
+std::string_view utils::FastaIndex::identification(size_t row) const
+{
+    return std::string_view(data + records[row].id_offset, records[row].id_length);
+}
+
+void utils::FastaIndex::read_columns(size_t row, size_t start, size_t end, std::string &out) const
+{
+    const Record &record = records[row];
+    if (end > record.length) end = record.length;
+    if (start >= end) return;
+
+    out.reserve(out.size() + end - start);
+    while (start < end)
+    {
+        size_t line = start / record.line_bases;
+        size_t column = start % record.line_bases;
+        size_t count = std::min(record.line_bases - column, end - start);
+        out.append(data + record.sequence_offset + line * record.line_bytes + column, count);
+        start += count;
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace utils
+{
+
+    // Memory-mapped FASTA with a per-record line index, for random access to column ranges
+    // without parsing or holding the whole alignment. Every line of a record except its last
+    // must have the same length (the layout written by Fasta::write_to and most tools).
+    class FastaIndex
+    {
+    private:
+        struct Record
+        {
+            size_t id_offset;
+            size_t id_length;
+            size_t sequence_offset;
+            size_t length;
+            size_t line_bases;
+            size_t line_bytes;
+        };
+
+        const char *data = nullptr;
+        size_t size = 0;
+        std::vector<Record> records;
+
+        void _index();
+
+    public:
+        explicit FastaIndex(const std::string &file_path);
+        ~FastaIndex();
+
+        FastaIndex(const FastaIndex &) = delete;
+        FastaIndex &operator=(const FastaIndex &) = delete;
+
+        size_t rows() const { return records.size(); }
+        size_t length(size_t row) const { return records[row].length; }
+        std::string_view identification(size_t row) const;
+
+        // Append columns [start, end) of a row to out
+        void read_columns(size_t row, size_t start, size_t end, std::string &out) const;
+    };
+
+}
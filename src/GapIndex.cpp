@@ -0,0 +1,99 @@
+#include "GapIndex.h"
+
+#include <algorithm>
+#include <cstring>
+
+// Bit k set when chars[k] is not a gap, for 8 chars at a time (little endian): every byte is compared with '-'
+// in one word, then the byte flags are gathered into the low 8 bits by a multiplication
+static uint64_t base_byte_mask(const char *chars)
+{
+    uint64_t word;
+    std::memcpy(&word, chars, 8);
+    const uint64_t low_bits = 0x7f7f7f7f7f7f7f7fULL;
+    const uint64_t x = word ^ 0x2d2d2d2d2d2d2d2dULL;
+    const uint64_t nonzero = (((x & low_bits) + low_bits) | x) & ~low_bits;
+    return ((nonzero >> 7) * 0x0102040810204080ULL) >> 56;
+}
+
+utils::GapIndex::GapIndex(const std::vector<std::string> &sequences)
+{
+    row_count = sequences.size();
+    column_count = sequences.empty() ? 0 : sequences[0].size();
+    words_per_row = (column_count + 63) / 64;
+    bits.assign(row_count * words_per_row, 0);
+    row_base_counts.assign(row_count, 0);
+    column_base_counts.assign(column_count, 0);
+    column_owners.assign(column_count, 0);
+    removed.assign(row_count, 0);
+
+    for (size_t i = 0; i < row_count; ++i)
+    {
+        const std::string &seq = sequences[i];
+        const size_t length = std::min(seq.size(), column_count);
+        uint64_t *row_bits = &bits[i * words_per_row];
+        for (size_t w = 0; w * 64 < length; ++w)
+        {
+            uint64_t word = 0;
+            const size_t end = std::min(length, w * 64 + 64);
+            size_t j = w * 64;
+            for (; j + 8 <= end; j += 8)
+            {
+                word |= base_byte_mask(seq.data() + j) << (j & 63);
+            }
+            for (; j < end; ++j)
+            {
+                word |= static_cast<uint64_t>(seq[j] != '-') << (j & 63);
+            }
+            row_bits[w] = word;
+            row_base_counts[i] += __builtin_popcountll(word);
+            for (uint64_t rest = word; rest; rest &= rest - 1)
+            {
+                const size_t j = w * 64 + __builtin_ctzll(rest);
+                ++column_base_counts[j];
+                column_owners[j] = i;
+            }
+        }
+    }
+}
+
+size_t utils::GapIndex::_next(size_t row, size_t column, bool base) const
+{
+    if (column >= column_count) return column_count;
+    const uint64_t *row_bits = &bits[row * words_per_row];
+    size_t w = column / 64;
+    uint64_t word = (base ? row_bits[w] : ~row_bits[w]) & (~0ULL << (column & 63));
+    while (!word)
+    {
+        if (++w == words_per_row) return column_count;
+        word = base ? row_bits[w] : ~row_bits[w];
+    }
+    return std::min(column_count, w * 64 + __builtin_ctzll(word));
+}
+
+void utils::GapIndex::remove_row(size_t row)
+{
+    if (removed[row]) return;
+    removed[row] = 1;
+    ++removed_count;
+    const uint64_t *row_bits = &bits[row * words_per_row];
+    for (size_t w = 0; w < words_per_row; ++w)
+    {
+        for (uint64_t rest = row_bits[w]; rest; rest &= rest - 1)
+        {
+            --column_base_counts[w * 64 + __builtin_ctzll(rest)];
+        }
+    }
+}
+
+std::vector<std::pair<size_t, size_t>> utils::GapIndex::base_column_runs() const
+{
+    std::vector<std::pair<size_t, size_t>> runs;
+    for (size_t j = 0; j < column_count; )
+    {
+        while (j < column_count && column_base_counts[j] == 0) ++j;
+        const size_t begin = j;
+        while (j < column_count && column_base_counts[j] > 0) ++j;
+        if (j > begin) runs.emplace_back(begin, j);
+    }
+    return runs;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace utils
+{
+
+    // Gap positions of an alignment, found once: a bitmap per row (bit j set when the row has a
+    // base in column j) with its base count, and the number of rows with bases per column. Gap
+    // and base runs are then found by bit scans, and per-row or per-column counts are looked up,
+    // instead of comparing characters again in every pass.
+    class GapIndex
+    {
+    private:
+        size_t row_count = 0;
+        size_t column_count = 0;
+        size_t words_per_row = 0;
+        std::vector<uint64_t> bits;
+        std::vector<uint32_t> row_base_counts;
+        std::vector<uint32_t> column_base_counts;
+        std::vector<size_t> column_owners;
+        std::vector<char> removed;
+        size_t removed_count = 0;
+
+        // First column at or after column whose bit in row equals base, or columns()
+        size_t _next(size_t row, size_t column, bool base) const;
+
+    public:
+        explicit GapIndex(const std::vector<std::string> &sequences);
+
+        size_t rows() const { return row_count; }
+        size_t columns() const { return column_count; }
+        size_t live_rows() const { return row_count - removed_count; }
+        bool is_removed(size_t row) const { return removed[row] != 0; }
+
+        uint32_t row_bases(size_t row) const { return row_base_counts[row]; }
+        uint32_t column_bases(size_t column) const { return column_base_counts[column]; }
+        // The last row with a base in the column, as built; the owner of a column with one base
+        size_t column_owner(size_t column) const { return column_owners[column]; }
+
+        size_t next_base(size_t row, size_t column) const { return _next(row, column, true); }
+        size_t next_gap(size_t row, size_t column) const { return _next(row, column, false); }
+
+        // Take a row out of the column counts, e.g. once it is set aside as garbage
+        void remove_row(size_t row);
+
+        // Maximal [begin, end) ranges of columns where some row left has a base
+        std::vector<std::pair<size_t, size_t>> base_column_runs() const;
+    };
+
+}
@@ -5,173 +5,432 @@
 #include <string_view>
 #include <algorithm>
 #include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
 #include <tuple>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include "IdTable.h"
 #include "Utils.h"
+#include "Report.h"
+#include "Mock.h"
+#include "Scheduler.h"
+#include "AlignerPolicy.h"
+#include "Prefilter.h"
+#include "ApproximateScore.h"
+#include "Placement.h"
+#include "Remote.h"
 
 extern std::string tmp_folder;
+extern unsigned thread_count;
 
-std::pair<std::vector<std::string>, std::vector<std::string>> slice_alignment(const std::vector<std::string> &sequences, int start, int end) {
-    std::vector<std::string> blocks;
-    std::vector<std::string> blocks_sequences;
-    for (const auto &seq : sequences) {
-        std::string curr_segment = std::string(seq).substr(start, end - start + 1);
-        blocks.push_back(curr_segment);
-        std::string no_gap(curr_segment);
-        no_gap.erase(remove(no_gap.begin(), no_gap.end(), '-'), no_gap.end());
-        blocks_sequences.push_back(no_gap);
-    }
-    return make_pair(blocks, blocks_sequences);
+// Block-local buffers of a worker thread. Every block refills them instead of allocating its
+// own, so the capacity grown by earlier blocks is reused and concurrent blocks do not contend in
+// the allocator; only the block a job returns gets fresh strings.
+struct BlockScratch {
+    std::vector<std::string> block;
+    std::vector<std::string> ungapped;
+    std::vector<std::string> aligned_ids;
+    std::vector<std::string> aligned;
+    std::vector<std::string> ordered;
+    std::string line;
+};
+
+// Refill block and ungapped with columns [start, end] of every row, with and without gaps
+void slice_alignment(const std::vector<std::string> &sequences, int start, int end, std::vector<std::string> &block, std::vector<std::string> &ungapped) {
+    block.resize(sequences.size());
+    ungapped.resize(sequences.size());
+    for (size_t i = 0; i < sequences.size(); ++i) {
+        block[i].assign(sequences[i], start, end - start + 1);
+        ungapped[i].clear();
+        for (char c : block[i]) {
+            if (c != '-') ungapped[i] += c;
+        }
+    }
 }
 
-// Function to find gap regions roughly in a sequence
-std::vector<std::pair<int, int>> find_gap_regions_roughly(const std::string &sequence, int max_non_gap_bases = 1, int min_region_length = 5) {
-    std::vector<std::pair<int, int>> regions;
-    int start = -1;
-    int non_gap_count = 0;
+// Refill ids and sequences with the records of a FASTA file, as utils::Fasta parses them;
+// returns the number of records
+size_t read_fasta_into(const std::string &file_path, std::vector<std::string> &ids, std::vector<std::string> &sequences, std::string &line) {
+    std::ifstream ifs(file_path);
+    size_t count = 0;
+    while (std::getline(ifs, line)) {
+        if (line.empty()) continue;
+        if (line[0] == '>') {
+            if (ids.size() <= count) {
+                ids.emplace_back();
+                sequences.emplace_back();
+            }
+            ids[count].assign(line, 1, std::string::npos);
+            sequences[count].clear();
+            ++count;
+        } else if (count > 0) {
+            sequences[count - 1] += line;
+        }
+    }
+    return count;
+}
 
-    for (size_t i = 0; i < sequence.length(); ++i) {
-        if (sequence[i] == '-') {
-            if (start == -1) {
-                start = i;
+// Append columns [start, end] of every row to the rows of final_sequence
+void append_columns(std::vector<std::string> &final_sequence, const std::vector<std::string> &sequences, int start, int end) {
+    for (size_t i = 0; i < sequences.size(); ++i) {
+        final_sequence[i].append(sequences[i], start, end - start + 1);
+    }
+}
+
+// Gap regions of a row of index: runs of gaps that may be interrupted by runs of at most
+// max_non_gap_bases bases, closed by a longer run of bases, and spanning at least
+// min_region_length columns; found by skipping from run to run with bit scans
+std::vector<std::pair<int, int>> find_gap_regions_roughly(const utils::GapIndex &index, size_t row, int max_non_gap_bases = 1, int min_region_length = 5) {
+    std::vector<std::pair<int, int>> regions;
+    const size_t length = index.columns();
+    const long long max_bases = max_non_gap_bases;
+    size_t j = index.next_gap(row, 0);
+    while (j < length) {
+        const size_t start = j;
+        while (true) {
+            const size_t bases_begin = index.next_base(row, j);
+            const size_t bases_end = index.next_gap(row, bases_begin);
+            if (bases_end == length && (bases_begin == length || static_cast<long long>(bases_end - bases_begin) <= max_bases)) {
+                // Unclosed at the end of the row, trailing short run of bases included
+                if (static_cast<long long>(length - start) >= min_region_length) {
+                    regions.emplace_back(start, length - 1);
+                }
+                return regions;
             }
-            non_gap_count = 0; // Reset non-gap counter within a gap region
-        } else {
-            if (start != -1) {
-                non_gap_count++;
-                if (non_gap_count > max_non_gap_bases) {
-                    // Check if the region length is at least min_region_length
-                    if ((i - non_gap_count - start) >= min_region_length) {
-                        regions.emplace_back(start, i - non_gap_count);
-                    }
-                    start = -1;
-                    non_gap_count = 0;
+            if (static_cast<long long>(bases_end - bases_begin) > max_bases) {
+                if (static_cast<long long>(bases_begin - 1 - start) >= min_region_length) {
+                    regions.emplace_back(start, bases_begin - 1);
                 }
+                j = bases_end;
+                break;
             }
+            j = bases_end;
         }
     }
+    return regions;
+}
 
-    // Check if there's an unclosed gap at the end of sequence and its length
-    if (start != -1 && (sequence.length() - start) >= min_region_length) {
-        regions.emplace_back(start, sequence.length() - 1);
+// Function to find gap regions roughly in a sequence
+std::vector<std::pair<int, int>> find_gap_regions_roughly(const std::string &sequence, int max_non_gap_bases = 1, int min_region_length = 5) {
+    return find_gap_regions_roughly(utils::GapIndex({sequence}), 0, max_non_gap_bases, min_region_length);
+}
+
+// Run the external MSA tool with the given arguments on raw_tmp and write its alignment to
+// aligned_tmp; *peak_rss_kb receives the measured peak RSS of the tool (0 for the in-process mock)
+void run_aligner(const std::string &msa, const std::string &arguments, const std::string &raw_tmp, const std::string &aligned_tmp, long *peak_rss_kb) {
+    *peak_rss_kb = 0;
+    if (msa == "mock") {
+        mock_align(raw_tmp, aligned_tmp);
+        return;
     }
 
-    return regions;
+    const std::string options = arguments.empty() ? "" : arguments + " ";
+    std::string command;
+    if (msa == "mafft") {
+        command = "mafft " + options + raw_tmp + " > " + aligned_tmp + " 2> /dev/null";
+    } else if (msa == "muscle3") {
+        command = "muscle " + options + "-in " + raw_tmp + " -out " + aligned_tmp + " 2> /dev/null";
+    } else {
+        command = "halign " + options + "-o " + raw_tmp + " " + aligned_tmp + " 2> /dev/null";
+    }
+    // halign3 runs on the JVM, whose heap reservation alone can exceed any sensible cap
+    run_limited(command, msa == "halign3" ? 0 : budget.address_space_cap, peak_rss_kb);
 }
 
-// Function to realign block
-std::vector<std::string> realign_block(std::string msa, const std::vector<std::string> &ids, const std::vector<std::string> &sequences, int start, int end) {
-    std::vector<std::string> block_sequence;
+// Align raw_tmp into aligned_tmp with this host's aligner. The job waits until it fits in the
+// memory and CPU budget next to the running ones, then the strategy is picked for the block
+// size and the aligner gets whatever spare cores it can use
+AlignerRun align_block_file(const std::string &msa, size_t rows, size_t columns, const std::string &raw_tmp, const std::string &aligned_tmp) {
+    AlignerRun run;
+    const AlignerPolicy &policy = select_policy(msa, rows, columns);
+    run.estimated_bytes = budget.estimate(msa, rows, columns);
+    run.threads = budget.acquire(run.estimated_bytes, policy.max_threads);
+    run.arguments = policy_arguments(msa, policy, run.threads);
+    auto aligner_start = std::chrono::steady_clock::now();
+    run_aligner(msa, run.arguments, raw_tmp, aligned_tmp, &run.peak_rss_kb);
+    run.seconds = Report::seconds_since(aligner_start);
+    budget.release(run.estimated_bytes, run.threads);
+    budget.observe(msa, run.estimated_bytes, static_cast<uint64_t>(run.peak_rss_kb) * 1024);
+    return run;
+}
 
-    std::string raw_tmp = tmp_folder + "/tmp.fasta";
-    std::string aligned_tmp = tmp_folder + "/tmp.aligned";
+// Function to realign block; sp_gain receives the SP improvement of the returned block
+// Rows are named by their surrogate in the aligner's files, so the sequence names are not needed
+std::vector<std::string> realign_block(const std::string &msa, const std::vector<std::string> &sequences, int start, int end, long long *sp_gain = nullptr) {
+    if (sp_gain) *sp_gain = 0;
+    thread_local BlockScratch scratch;
+    std::vector<std::string> &block = scratch.block;
+    slice_alignment(sequences, start, end, block, scratch.ungapped);
+    if (end - start < 4) {
+        return block;
+    }
+    const char *reject_reason = prefilter.reject_reason(block, scratch.ungapped);
+    if (reject_reason && !prefilter.audit) {
+        logger.log(LOG_DEBUG, "Block ", start, "-", end, " skipped: ", reject_reason);
+        return block;
+    }
 
-    if (end - start >= 4) {
-        auto before_realign_sequence = slice_alignment(sequences, start, end);
-//        auto before_realign_sequence_preprocessed = preprocess(before_realign_sequence.first);
-        long long sp_before_realign = score(before_realign_sequence.first, 0, before_realign_sequence.first[0].size());
+    // Blocks may be realigned concurrently, so every call gets its own scratch files
+    static std::atomic<unsigned> block_counter{0};
+    const std::string block_name = tmp_folder + "/block_" + std::to_string(block_counter++);
+    std::string raw_tmp = block_name + ".fasta";
+    std::string aligned_tmp = block_name + ".aligned";
 
-        utils::Fasta tmp_block;
-        std::ofstream ofs(raw_tmp);
-        if (!ofs) {
-            std::cerr << "Error: cannot open file " + raw_tmp << std::endl;
-            std::cerr << "Please make sure the file path is correct and has appropriate permissions." << std::endl;
-            exit(1);
-        }
-        tmp_block.identifications = ids;
-        tmp_block.sequences = before_realign_sequence.second;
-        tmp_block.write_to(ofs);
-        ofs.close();
-
-        if (msa == "mafft") {
-            std::string command_mafft = "mafft " + raw_tmp + " > " + aligned_tmp + " 2> /dev/null";
-            system(command_mafft.c_str());
-        } else {
-            std::string command_halign3 = "halign -o " + raw_tmp + " " + aligned_tmp +" 2> /dev/null"; 
-            system(command_halign3.c_str());
+    const size_t rows = sequences.size();
+    std::ofstream ofs(raw_tmp);
+    if (!ofs) {
+        std::cerr << "Error: cannot open file " + raw_tmp << std::endl;
+        std::cerr << "Please make sure the file path is correct and has appropriate permissions." << std::endl;
+        exit(1);
+    }
+    for (size_t i = 0; i < rows; ++i) {
+        ofs << '>' << utils::IdTable::surrogate(i) << '\n';
+        utils::Fasta::cut_and_write(ofs, scratch.ungapped[i]);
+        ofs << '\n';
+    }
+    ofs.close();
 
+    // With -workers the block is aligned on a worker, unless none is left
+    const size_t block_columns = block[0].length();
+    AlignerRun run;
+    if (!remote_workers.enabled() || !remote_workers.align(msa, rows, block_columns, raw_tmp, aligned_tmp, &run)) {
+        run = align_block_file(msa, rows, block_columns, raw_tmp, aligned_tmp);
+    }
+
+    // An aligner that failed, e.g. over its memory cap, leaves no output
+    size_t aligned_count = 0;
+    std::error_code error;
+    if (std::filesystem::file_size(aligned_tmp, error) > 0 && !error) {
+        aligned_count = read_fasta_into(aligned_tmp, scratch.aligned_ids, scratch.aligned, scratch.line);
+    }
+    std::filesystem::remove(raw_tmp);
+    std::filesystem::remove(aligned_tmp);
+
+    std::vector<std::string> *realigned = &scratch.aligned;
+    if (aligned_count == 0) {
+        logger.log(LOG_DEBUG, "No output from ", msa, " ", run.arguments, " for block ", start, "-", end);
+    } else if (msa == "muscle3") {
+        // muscle reorders its output and drops empty sequences, so put rows back by their surrogate
+        const size_t realigned_length = scratch.aligned[0].size();
+        scratch.ordered.resize(rows);
+        for (auto &row : scratch.ordered) {
+            row.assign(realigned_length, '-');
         }
-        
-        auto after_realign_sequence = read_from(aligned_tmp);
-        long long sp_after_realign = score(after_realign_sequence.sequences, 0, after_realign_sequence.sequences[0].size());
-
-        std::cout << "****************************" << std::endl;
-        std::cout << "Block length: " << before_realign_sequence.first[0].length() << std::endl;
-        if (sp_after_realign > sp_before_realign) {
-            std::cout << "SP before: " << sp_before_realign << std::endl;
-            std::cout << "SP after: " << sp_after_realign << std::endl;
-            block_sequence = after_realign_sequence.sequences;
-        } else {
-            block_sequence = std::vector<std::string>(before_realign_sequence.first.begin(), before_realign_sequence.first.end());
+        for (size_t k = 0; k < aligned_count; ++k) {
+            size_t row;
+            if (utils::IdTable::parse_surrogate(scratch.aligned_ids[k], row) && row < rows) {
+                scratch.ordered[row].swap(scratch.aligned[k]);
+            }
         }
-    } else {
-        auto sliced = slice_alignment(sequences, start, end).first;
-        block_sequence = std::vector<std::string>(sliced.begin(), sliced.end());
+        aligned_count = rows;
+        realigned = &scratch.ordered;
+    }
+    realigned->resize(aligned_count);
+
+    // A failed or truncated aligner run leaves the block as it was
+    // With -approx-sp both versions are first compared on sampled rows; the scores are then estimates
+    bool valid = aligned_count == rows && !(*realigned)[0].empty();
+    long long sp_before_realign, sp_after_realign;
+    if (!valid || !approximate_score.compare(block, *realigned, &sp_before_realign, &sp_after_realign)) {
+        sp_before_realign = score(block, 0, block[0].size());
+        sp_after_realign = valid ? score(*realigned, 0, (*realigned)[0].size()) : sp_before_realign;
+    }
+    bool accepted = sp_after_realign > sp_before_realign;
+    if (reject_reason) {
+        // Audit run of a block the pre-filter rejected: count it, but keep the decision
+        prefilter.record_audit(accepted);
+        if (accepted) {
+            logger.log(LOG_DEBUG, "Block ", start, "-", end, " skipped (", reject_reason, ") but gains ", sp_after_realign - sp_before_realign);
+        }
+        accepted = false;
+    }
+
+    report.add_block({start, end, rows, block_columns, run.seconds, sp_before_realign, sp_after_realign, accepted,
+                      static_cast<long>(run.estimated_bytes / 1024), run.peak_rss_kb, run.arguments, run.threads});
+
+    if (accepted) {
+        logger.log(LOG_INFO, "****************************\nBlock length: ", block_columns,
+                   "\nSP before: ", sp_before_realign, "\nSP after: ", sp_after_realign);
+        if (sp_gain) *sp_gain = sp_after_realign - sp_before_realign;
+        return *realigned;
+    }
+    logger.log(LOG_INFO, "****************************\nBlock length: ", block_columns);
+    return block;
+}
+
+void join_blocks(std::vector<std::string> &final_sequence, const std::vector<std::string> &block_seqs) {
+    for (size_t i = 0; i < block_seqs.size(); ++i) {
+        final_sequence[i] += block_seqs[i];
+    }
+}
+
+// Compute the non-gap base threshold of find_gap_regions_roughly from the star sequence
+double gap_region_distance(const std::string &star_sequence, size_t sequence_count) {
+    if (sequence_count > 1000) {
+        return 10;
     }
 
-    return block_sequence;
+    std::vector<int> base_count = count_characters_between_dashes(star_sequence);
+    if (base_count.empty()) {
+        return 10;
+    }
+    int sum = std::accumulate(base_count.begin(), base_count.end(), 0);
+    double distance = static_cast<double>(sum) / base_count.size();
+    return distance > 10 ? 10 : distance;
 }
 
-std::vector<std::string> realign_block_muscle(const std::vector<std::string> &ids, const std::vector<std::string> &sequences, int start, int end) {
-    std::vector<std::string> block_sequence;
+// Outcome of one realignment pass: total SP gain and the output columns of the accepted blocks
+struct RegionPass {
+    long long sp_gain = 0;
+    std::vector<std::pair<int, int>> changed;
+};
 
-    std::string raw_tmp = tmp_folder + "/tmp.fasta";
-    std::string aligned_tmp = tmp_folder + "/tmp.aligned";
+// Realigned blocks kept across runs on the same rows, keyed by a scope naming the rows and the
+// aligner (e.g. "mafft w=10") and the block's columns. persist, when set, is called with every
+// block added by a realignment, e.g. to checkpoint it.
+struct BlockCache {
+    std::string scope;
+    std::map<std::tuple<std::string, int, int>, std::pair<std::vector<std::string>, long long>> blocks;
+    unsigned long hits = 0;
+    unsigned long misses = 0;
+    std::mutex mutex;
+    std::function<void(const std::tuple<std::string, int, int> &, const std::vector<std::string> &, long long)> persist;
+};
 
-    if (end - start >= 4) {
-        auto before_realign_sequence = slice_alignment(sequences, start, end);
-//        auto before_realign_sequence_preprocessed = preprocess(before_realign_sequence.first);
-        long long sp_before_realign = score(before_realign_sequence.first, 0, before_realign_sequence.first[0].size());
+// Realign every gap region and stitch the untouched columns in between. Up to thread_count
+// blocks are realigned concurrently while this thread stitches each block into the rows as
+// soon as it and every block before it are done, so finished blocks are not held until the end.
+// Blocks found in cache are reused instead of realigned, and new ones are added to it.
+std::vector<std::string> realign_regions(const std::string &msa, const std::vector<std::string> &sequences, const std::vector<std::pair<int, int>> &gap_regions,
+                                         RegionPass *pass = nullptr, BlockCache *cache = nullptr) {
+    const size_t job_count = gap_regions.size();
+    std::vector<std::vector<std::string>> blocks(job_count);
+    std::vector<long long> gains(job_count, 0);
+    std::vector<char> done(job_count, 0);
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::atomic<size_t> next_job{0};
 
-        utils::Fasta tmp_block;
-        std::ofstream ofs(raw_tmp);
-        if (!ofs) {
-            std::cerr << "Error: cannot open file " + raw_tmp << std::endl;
-            std::cerr << "Please make sure the file path is correct and has appropriate permissions." << std::endl;
-            exit(1);
-        }
-        tmp_block.identifications = ids;
-        tmp_block.sequences = before_realign_sequence.second;
-        tmp_block.write_to(ofs);
-        ofs.close();
-
-        std::string command_muscle3 = "muscle -in " + raw_tmp + " -out " + aligned_tmp + " 2> /dev/null"; 
-        system(command_muscle3.c_str());
-        auto realigned_part_sequences = read_from(aligned_tmp);
-        int realigned_length = realigned_part_sequences.sequences[0].size();
-
-        std::vector<std::string> after_realign_sequence;
-        after_realign_sequence.reserve(ids.size());
-        for (const auto &curr_id : ids) {
-            int index = find_string_index(curr_id, realigned_part_sequences.identifications);
-            if (index == -1) {
-                after_realign_sequence.push_back(std::string(realigned_length, '-'));
-            } else {
-                after_realign_sequence.push_back(realigned_part_sequences.sequences[index]);
+    auto worker = [&](unsigned t) {
+        placement.pin_worker(t);
+        for (size_t k; (k = next_job++) < job_count; ) {
+            long long sp_gain = 0;
+            std::vector<std::string> block;
+            const auto key = std::make_tuple(cache ? cache->scope : std::string(), gap_regions[k].first, gap_regions[k].second);
+            bool cached = false;
+            if (cache) {
+                std::lock_guard<std::mutex> lock(cache->mutex);
+                auto it = cache->blocks.find(key);
+                if (it != cache->blocks.end()) {
+                    block = it->second.first;
+                    sp_gain = it->second.second;
+                    cached = true;
+                    ++cache->hits;
+                } else {
+                    ++cache->misses;
+                }
+            }
+            if (!cached) {
+                block = realign_block(msa, sequences, gap_regions[k].first, gap_regions[k].second, &sp_gain);
+                if (cache) {
+                    std::lock_guard<std::mutex> lock(cache->mutex);
+                    cache->blocks.emplace(key, std::make_pair(block, sp_gain));
+                }
+                if (cache && cache->persist) {
+                    cache->persist(key, block, sp_gain);
+                }
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                blocks[k] = std::move(block);
+                gains[k] = sp_gain;
+                done[k] = 1;
             }
+            ready.notify_all();
         }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < std::max(1u, thread_count) && t < job_count; ++t) {
+        workers.emplace_back(worker, t);
+    }
 
-        long long sp_after_realign = score(after_realign_sequence, 0, after_realign_sequence[0].size());
+    std::vector<std::string> final_sequence(sequences.size(), "");
+    const int sequence_length = sequences[0].length();
+    int next_column = 0;
 
-        std::cout << "****************************" << std::endl;
-        std::cout << "Block length: " << before_realign_sequence.first[0].length() << std::endl;
-        if (sp_after_realign > sp_before_realign) {
-            std::cout << "SP before: " << sp_before_realign << std::endl;
-            std::cout << "SP after: " << sp_after_realign << std::endl;
-            block_sequence = after_realign_sequence;
-        } else {
-            block_sequence = std::vector<std::string>(before_realign_sequence.first.begin(), before_realign_sequence.first.end());
+    for (size_t k = 0; k < job_count; ++k) {
+        const auto &region = gap_regions[k];
+        if (region.first > next_column) {
+            append_columns(final_sequence, sequences, next_column, region.first - 1);
         }
-    } else {
-        auto sliced = slice_alignment(sequences, start, end).first;
-        block_sequence = std::vector<std::string>(sliced.begin(), sliced.end());
+
+        std::vector<std::string> block;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready.wait(lock, [&] { return done[k] != 0; });
+            block = std::move(blocks[k]);
+        }
+        const int block_start = final_sequence[0].size();
+        join_blocks(final_sequence, block);
+        if (pass && gains[k] > 0) {
+            pass->sp_gain += gains[k];
+            pass->changed.emplace_back(block_start, static_cast<int>(final_sequence[0].size()) - 1);
+        }
+        next_column = region.second + 1;
+    }
+    if (next_column < sequence_length) {
+        append_columns(final_sequence, sequences, next_column, sequence_length - 1);
     }
 
-    return block_sequence;
+    for (auto &t : workers) {
+        t.join();
+    }
+    // The stitched rows are new buffers, placed like the rows they replace
+    placement.apply(final_sequence);
+    return final_sequence;
 }
 
-void join_blocks(std::vector<std::string> &final_sequence, const std::vector<std::string> &block_seqs) {
-    for (size_t i = 0; i < block_seqs.size(); ++i) {
-        final_sequence[i] += block_seqs[i];
+// Further passes after a first one: the star row is unchanged by realignment (its bases stay the
+// same), so only the gap regions within `margin` columns of a block accepted in the previous pass
+// are realigned again. Stops after max_passes passes in total (0 = no limit), when a pass gains
+// less than min_gain, or when nothing changed. With a cache, the blocks of pass n are scoped
+// scope + "pass<n>".
+void refine_passes(const std::string &msa, std::vector<std::string> &sequences, size_t star_index, double distance, int min_region_length,
+                   RegionPass pass, int max_passes, long long min_gain, BlockCache *cache = nullptr, const std::string &scope = "") {
+    const int margin = static_cast<int>(distance) + 1;
+    for (int pass_number = 2; max_passes == 0 || pass_number <= max_passes; ++pass_number) {
+        if (pass.changed.empty() || pass.sp_gain < min_gain) {
+            break;
+        }
+
+        std::vector<std::pair<int, int>> candidates;
+        size_t c = 0;
+        for (const auto &region : find_gap_regions_roughly(sequences[star_index], distance, min_region_length)) {
+            while (c < pass.changed.size() && pass.changed[c].second + margin < region.first) {
+                ++c;
+            }
+            if (c < pass.changed.size() && pass.changed[c].first - margin <= region.second) {
+                candidates.push_back(region);
+            }
+        }
+        logger.log(LOG_INFO, "Pass ", pass_number, ": ", candidates.size(), " gap regions next to changed blocks");
+        if (candidates.empty()) {
+            break;
+        }
+
+        RegionPass next;
+        if (cache) {
+            cache->scope = scope + "pass" + std::to_string(pass_number);
+        }
+        sequences = realign_regions(msa, sequences, candidates, &next, cache);
+        logger.log(LOG_INFO, "Pass ", pass_number, " SP gain: ", next.sp_gain);
+        pass = std::move(next);
     }
 }
+
 #endif //REFINE_STAR_GAPREGION_H
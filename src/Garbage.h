@@ -5,13 +5,23 @@
 #include <vector>
 #include <string>
 #include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdint>
 #include <algorithm> // for std::sort
-#include <optional>
+#include <atomic>
+#include <thread>
+#include "Kmer.h"
+#include "Placement.h"
+#include "Report.h"
+#include "Utils.h"
+
+extern unsigned thread_count;
 
-std::optional<int> is_single_base_sequence(const std::vector<std::string>& region) {
-    std::optional<int> base_index = std::nullopt;
+std::optional<size_t> is_single_base_sequence(const std::vector<std::string>& region) {
+    std::optional<size_t> base_index = std::nullopt;
 
-    for (int i = 0; i < region.size(); ++i) {
+    for (size_t i = 0; i < region.size(); ++i) {
         const std::string& segment = region[i];
         bool has_base = false;
 
@@ -35,30 +45,125 @@ std::optional<int> is_single_base_sequence(const std::vector<std::string>& regio
     return base_index;
 }
 
-std::unordered_set<unsigned int> scan_sequences(const std::vector<std::string>& sequences, int window_length) {
-    int sequence_length = sequences[0].size();
-    std::set<int> seen_sequences;
-
-    // 滑动窗口遍历序列
-    for (int start = 0; start <= sequence_length - window_length; ++start) {
-        std::vector<std::string> region;
-
-        for (const auto& seq : sequences) {
-            region.push_back(seq.substr(start, window_length));
-        }
+// Rows that are the only row with bases in some window of window_length columns. The index
+// summarises every column by its number of rows with bases and, for single-row columns, that
+// row; the windows slide over the summaries, so the scan is O(columns) for any window
+std::unordered_set<size_t> scan_sequences(const utils::GapIndex &index, size_t window_length) {
+    const size_t sequence_length = index.columns();
+    std::unordered_set<size_t> result;
+    if (window_length == 0 || window_length > sequence_length) {
+        return result;
+    }
 
-        std::optional<int> base_index = is_single_base_sequence(region);
-        if (base_index.has_value() && seen_sequences.find(base_index.value()) == seen_sequences.end()) {
-            seen_sequences.insert(base_index.value());
+    // A window qualifies when it has no column shared by several rows and its single-row
+    // columns all belong to one row; track both while sliding
+    size_t shared_columns = 0;
+    std::unordered_map<size_t, size_t> owner_columns;
+    auto add = [&](size_t j) {
+        if (index.column_bases(j) >= 2) ++shared_columns;
+        else if (index.column_bases(j) == 1) ++owner_columns[index.column_owner(j)];
+    };
+    auto remove = [&](size_t j) {
+        if (index.column_bases(j) >= 2) --shared_columns;
+        else if (index.column_bases(j) == 1 && --owner_columns[index.column_owner(j)] == 0) owner_columns.erase(index.column_owner(j));
+    };
+
+    for (size_t j = 0; j < sequence_length; ++j) {
+        add(j);
+        if (j >= window_length) remove(j - window_length);
+        if (j + 1 >= window_length && shared_columns == 0 && owner_columns.size() == 1) {
+            result.insert(owner_columns.begin()->first);
         }
     }
-
-    std::unordered_set<unsigned int> result(seen_sequences.begin(), seen_sequences.end());
     return result;
 }
 
+std::unordered_set<size_t> scan_sequences(const std::vector<std::string>& sequences, size_t window_length) {
+    return scan_sequences(utils::GapIndex(sequences), window_length);
+}
 
+// Whether a row is the only one with bases in some window of window_length columns,
+// given the number of non-gap characters of every column
+bool is_lone_row(const std::string &row, const std::vector<unsigned> &column_bases, int window_length) {
+    const int sequence_length = row.size();
+    int others = 0;
+    int own = 0;
+    for (int j = 0; j < sequence_length; ++j) {
+        const bool base = row[j] != '-';
+        own += base;
+        others += column_bases[j] - base > 0;
+        if (j >= window_length) {
+            const bool old_base = row[j - window_length] != '-';
+            own -= old_base;
+            others -= column_bases[j - window_length] - old_base > 0;
+        }
+        if (j >= window_length - 1 && own > 0 && others == 0) {
+            return true;
+        }
+    }
+    return false;
+}
 
+// Majority base of every column where bases outnumber gaps, i.e. the ungapped consensus row
+std::string consensus_sequence(const std::vector<std::string> &sequences) {
+    const size_t sequence_length = sequences[0].size();
+    std::vector<uint64_t> counts(sequence_length * SYMBOL_CLASSES, 0);
+    for (const auto &seq : sequences) {
+        for (size_t j = 0; j < sequence_length && j < seq.size(); ++j) {
+            ++counts[j * SYMBOL_CLASSES + symbol_classes[seq[j]]];
+        }
+    }
+    std::string consensus;
+    for (size_t j = 0; j < sequence_length; ++j) {
+        const uint64_t *column = &counts[j * SYMBOL_CLASSES];
+        const uint64_t bases = column[SYMBOL_A] + column[SYMBOL_C] + column[SYMBOL_G] + column[SYMBOL_T] + column[SYMBOL_N];
+        if (bases <= column[SYMBOL_GAP]) continue;
+        const int best = std::max_element(column, column + SYMBOL_N) - column;
+        consensus += column[best] > 0 ? "ACGT"[best] : 'N';
+    }
+    return consensus;
+}
+
+// Rows whose estimated per-base divergence from the consensus exceeds max_divergence. A MinHash
+// sketch of every row is checked against the k-mers of the consensus, thread_count rows at a
+// time; a sketch measures containment, so rows covering only part of the alignment are not
+// flagged for being short. With the rows partitioned over NUMA nodes, each worker first takes
+// the rows of its own node. Rows with fewer than min_sketch distinct k-mers (all gaps, or only a
+// few bases) give no evidence either way and are left to the gap-based scan.
+std::unordered_set<size_t> find_divergent_rows(const std::vector<std::string> &sequences, double max_divergence, unsigned k = 12, size_t sketch_size = 256,
+                                               size_t min_sketch = 16) {
+    const std::vector<uint64_t> reference = kmer_hashes(consensus_sequence(sequences), k);
+    std::vector<char> divergent(sequences.size(), 0);
+    const size_t parts = placement.partitions();
+    std::vector<std::atomic<size_t>> next_row(parts);
+    for (size_t p = 0; p < parts; ++p) {
+        next_row[p] = sequences.size() * p / parts;
+    }
+    auto worker = [&](unsigned t) {
+        placement.pin_worker(t);
+        const size_t home = placement.node_of_worker(t) % parts;
+        for (size_t q = 0; q < parts; ++q) {
+            const size_t p = (home + q) % parts;
+            const size_t end = sequences.size() * (p + 1) / parts;
+            for (size_t i; (i = next_row[p]++) < end; ) {
+                const std::vector<uint64_t> sketch = minhash_sketch(sequences[i], k, sketch_size);
+                divergent[i] = sketch.size() >= min_sketch && sketch_divergence(sketch, reference, k) > max_divergence;
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < std::max(1u, thread_count) && t < sequences.size(); ++t) {
+        workers.emplace_back(worker, t);
+    }
+    for (auto &t : workers) {
+        t.join();
+    }
 
+    std::unordered_set<size_t> result;
+    for (size_t i = 0; i < sequences.size(); ++i) {
+        if (divergent[i]) result.insert(i);
+    }
+    return result;
+}
 
 #endif //REFINE_STAR_GARBAGE_H
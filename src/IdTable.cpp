@@ -0,0 +1,29 @@
+#include "IdTable.h"
+
+#include <charconv>
+
+void utils::IdTable::reserve(size_t rows, size_t bytes)
+{
+    offsets.reserve(rows + 1);
+    arena.reserve(bytes);
+}
+
+size_t utils::IdTable::add(std::string_view name)
+{
+    arena.append(name);
+    offsets.push_back(arena.size());
+    return size() - 1;
+}
+
+std::string utils::IdTable::surrogate(size_t row)
+{
+    return std::to_string(row);
+}
+
+bool utils::IdTable::parse_surrogate(std::string_view name, size_t &row)
+{
+    // Tools may keep text after the first space of a name line; only the leading number counts
+    const char *last = name.data() + name.size();
+    auto [end, error] = std::from_chars(name.data(), last, row);
+    return error == std::errc() && end != name.data() && (end == last || *end == ' ' || *end == '\t');
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace utils
+{
+
+    // Interned sequence names: one arena holding every name back to back, addressed by row.
+    // Temporary files name each row by its surrogate, the decimal row index, so names are neither
+    // copied per block nor matched back by string; they only reappear in the final output.
+    class IdTable
+    {
+    private:
+        std::string arena;
+        std::vector<size_t> offsets{0};
+
+    public:
+        class const_iterator
+        {
+        private:
+            const IdTable *table;
+            size_t row;
+
+        public:
+            const_iterator(const IdTable *table, size_t row) : table(table), row(row) {}
+
+            std::string_view operator*() const { return (*table)[row]; }
+            const_iterator &operator++() { ++row; return *this; }
+            bool operator==(const const_iterator &other) const { return row == other.row; }
+            bool operator!=(const const_iterator &other) const { return row != other.row; }
+        };
+
+        IdTable() = default;
+
+        void reserve(size_t rows, size_t bytes);
+
+        // Add a name and return its row
+        size_t add(std::string_view name);
+
+        size_t size() const { return offsets.size() - 1; }
+        bool empty() const { return size() == 0; }
+        std::string_view operator[](size_t row) const { return std::string_view(arena).substr(offsets[row], offsets[row + 1] - offsets[row]); }
+
+        const_iterator begin() const { return const_iterator(this, 0); }
+        const_iterator end() const { return const_iterator(this, size()); }
+
+        // Name of a row in temporary files, and the row of such a name (false if it is not one)
+        static std::string surrogate(size_t row);
+        static bool parse_surrogate(std::string_view name, size_t &row);
+    };
+
+}
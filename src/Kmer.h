@@ -0,0 +1,115 @@
+#ifndef REFINE_STAR_KMER_H
+#define REFINE_STAR_KMER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Utils.h"
+
+// Call f with the code of every k-mer of a row over ACGT (U counts as T; k is at most 16). Gaps
+// are skipped, so the k-mers of a gapped row are those of its bases; other symbols end a k-mer.
+template <typename F>
+void for_each_kmer(const std::string &sequence, unsigned k, F f) {
+    const uint32_t mask = k >= 16 ? ~0u : (1u << (2 * k)) - 1;
+    uint32_t code = 0;
+    unsigned run = 0;
+    for (char c : sequence) {
+        const uint8_t base = symbol_classes[c];
+        if (base == SYMBOL_GAP) continue;
+        if (base == SYMBOL_N) {
+            run = 0;
+            continue;
+        }
+        code = (code << 2 | base) & mask;
+        if (++run >= k) f(code);
+    }
+}
+
+// Sorted codes of the k-mers of a sequence
+std::vector<uint32_t> kmer_codes(const std::string &sequence, unsigned k = 6) {
+    std::vector<uint32_t> codes;
+    if (sequence.size() >= k) codes.reserve(sequence.size() - k + 1);
+    for_each_kmer(sequence, k, [&](uint32_t code) { codes.push_back(code); });
+    std::sort(codes.begin(), codes.end());
+    return codes;
+}
+
+// Fractional common k-mer distance: 1 - (shared k-mers, counted with multiplicity) / (k-mers of
+// the shorter sequence); 1 when either has none
+double kmer_distance(const std::vector<uint32_t> &x, const std::vector<uint32_t> &y) {
+    const size_t shorter = std::min(x.size(), y.size());
+    if (shorter == 0) return 1;
+    size_t common = 0;
+    for (size_t i = 0, j = 0; i < x.size() && j < y.size(); ) {
+        if (x[i] < y[j]) {
+            ++i;
+        } else if (y[j] < x[i]) {
+            ++j;
+        } else {
+            ++common;
+            ++i;
+            ++j;
+        }
+    }
+    return 1 - static_cast<double>(common) / shorter;
+}
+
+// Leader clustering: every sequence joins the first cluster whose leader is within max_distance,
+// or leads a new one. Each cluster lists its members in input order, its leader first.
+std::vector<std::vector<size_t>> cluster_by_kmers(const std::vector<std::string> &sequences, double max_distance, unsigned k = 6) {
+    std::vector<std::vector<size_t>> clusters;
+    std::vector<std::vector<uint32_t>> leaders;
+    for (size_t i = 0; i < sequences.size(); ++i) {
+        std::vector<uint32_t> codes = kmer_codes(sequences[i], k);
+        size_t c = 0;
+        while (c < leaders.size() && kmer_distance(codes, leaders[c]) > max_distance) {
+            ++c;
+        }
+        if (c == leaders.size()) {
+            leaders.push_back(std::move(codes));
+            clusters.emplace_back();
+        }
+        clusters[c].push_back(i);
+    }
+    return clusters;
+}
+
+// Mixes a k-mer code into a well-spread 64-bit hash (the splitmix64 finalizer)
+uint64_t kmer_hash(uint64_t code) {
+    code = (code ^ (code >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    code = (code ^ (code >> 27)) * 0x94d049bb133111ebULL;
+    return code ^ (code >> 31);
+}
+
+// Sorted distinct hashes of all the k-mers of a sequence
+std::vector<uint64_t> kmer_hashes(const std::string &sequence, unsigned k) {
+    std::vector<uint64_t> hashes;
+    for_each_kmer(sequence, k, [&](uint32_t code) { hashes.push_back(kmer_hash(code)); });
+    std::sort(hashes.begin(), hashes.end());
+    hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+    return hashes;
+}
+
+// Bottom-s MinHash sketch: the size smallest distinct k-mer hashes of a sequence, sorted
+std::vector<uint64_t> minhash_sketch(const std::string &sequence, unsigned k, size_t size) {
+    std::vector<uint64_t> sketch = kmer_hashes(sequence, k);
+    if (sketch.size() > size) sketch.resize(size);
+    return sketch;
+}
+
+// Per-base divergence of a sequence from a reference, estimated from the fraction C of its
+// sketch found among the reference's k-mers as 1 - C^(1/k), the containment form of the Mash
+// distance; 1 for an empty sketch, so callers should not judge rows with too few k-mers by it.
+// reference_hashes must be sorted.
+double sketch_divergence(const std::vector<uint64_t> &sketch, const std::vector<uint64_t> &reference_hashes, unsigned k) {
+    if (sketch.empty()) return 1;
+    size_t contained = 0;
+    for (uint64_t hash : sketch) {
+        contained += std::binary_search(reference_hashes.begin(), reference_hashes.end(), hash);
+    }
+    return 1 - std::pow(static_cast<double>(contained) / sketch.size(), 1.0 / k);
+}
+
+#endif //REFINE_STAR_KMER_H
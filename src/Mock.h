@@ -0,0 +1,61 @@
+#ifndef REFINE_STAR_MOCK_H
+#define REFINE_STAR_MOCK_H
+
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Utils.h"
+
+// Simulated latency of every mock aligner call, in milliseconds
+extern unsigned mock_latency_ms;
+
+void mock_sleep() {
+    if (mock_latency_ms > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(mock_latency_ms));
+    }
+}
+
+// Pad every sequence with trailing gaps to the longest length
+void pad_to_longest(std::vector<std::string> &sequences) {
+    size_t width = 0;
+    for (const auto &seq : sequences) {
+        width = std::max(width, seq.size());
+    }
+    for (auto &seq : sequences) {
+        seq.append(width - seq.size(), '-');
+    }
+}
+
+void write_fasta(const std::string &file_path, const utils::Fasta &fasta) {
+    std::ofstream ofs(file_path);
+    if (!ofs) {
+        std::cerr << "Error: cannot open file " + file_path << std::endl;
+        std::cerr << "Please make sure the file path is correct and has appropriate permissions." << std::endl;
+        exit(1);
+    }
+    fasta.write_to(ofs);
+    ofs.close();
+}
+
+// Deterministic stand-in for the MSA tools: the ungapped block, left-justified and padded with gaps
+void mock_align(const std::string &raw_tmp, const std::string &aligned_tmp) {
+    mock_sleep();
+    utils::Fasta block = read_from(raw_tmp);
+    pad_to_longest(block.sequences);
+    write_fasta(aligned_tmp, block);
+}
+
+// Stand-in for profileAlignment.jar: append the sequences to the profile and pad both to the same width
+void mock_profile_merge(const std::string &sequence_file, const std::string &profile_file, const std::string &output_file) {
+    mock_sleep();
+    utils::Fasta profile = read_from(profile_file);
+    utils::Fasta sequences = read_from(sequence_file);
+    profile.identifications.insert(profile.identifications.end(), sequences.identifications.begin(), sequences.identifications.end());
+    profile.sequences.insert(profile.sequences.end(), sequences.sequences.begin(), sequences.sequences.end());
+    pad_to_longest(profile.sequences);
+    write_fasta(output_file, profile);
+}
+
+#endif //REFINE_STAR_MOCK_H
@@ -0,0 +1,125 @@
+#ifndef REFINE_STAR_PIPELINE_H
+#define REFINE_STAR_PIPELINE_H
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "ApproximateScore.h"
+#include "Checkpoint.h"
+#include "GapIndex.h"
+#include "GapRegion.h"
+#include "Garbage.h"
+#include "Placement.h"
+#include "Prefilter.h"
+#include "ProfileMerge.h"
+#include "Report.h"
+
+// Steps of a run on an alignment held in memory, shared by a normal run and the requests of a
+// daemon, and the parameters that change their result
+struct PipelineOptions {
+    std::string msa = "mafft";
+    int window_length = 10;
+    int min_region_length = 5;
+    int iterations = 1;
+    long long min_gain = 1;
+    size_t sample_rows = 0;
+    double max_divergence = 0;
+    double garbage_cluster_distance = 0;
+};
+
+// Rows to set aside as garbage: those alone in some window of window_length columns and, with
+// max_divergence, those too far from the consensus
+std::unordered_set<size_t> find_garbage_rows(const PipelineOptions &options, const utils::GapIndex &gap_index, const std::vector<std::string> &sequences) {
+    std::unordered_set<size_t> garbage_index = scan_sequences(gap_index, options.window_length);
+    if (options.max_divergence > 0) {
+        std::unordered_set<size_t> divergent = find_divergent_rows(sequences, options.max_divergence);
+        logger.log(LOG_INFO, "Divergent sequences: ", divergent.size());
+        garbage_index.insert(divergent.begin(), divergent.end());
+    }
+    return garbage_index;
+}
+
+// Split the rows into the profile and the garbage rows, both in input order, the garbage rows
+// without their gaps. The garbage rows are taken out of gap_index, and the columns they leave
+// with gaps only are removed from the profile.
+void split_garbage(std::vector<std::string> &&sequences, const std::unordered_set<size_t> &garbage_index, utils::GapIndex &gap_index,
+                   std::vector<std::string> &profile_sequences, std::vector<std::string> &garbage_sequences) {
+    if (garbage_index.empty()) {
+        profile_sequences = std::move(sequences);
+        return;
+    }
+    garbage_sequences.reserve(garbage_index.size());
+    profile_sequences.reserve(sequences.size() - garbage_index.size());
+    for (size_t i = 0; i < sequences.size(); ++i) {
+        if (garbage_index.count(i)) {
+            std::string sequence = std::move(sequences[i]);
+            sequence.erase(std::remove(sequence.begin(), sequence.end(), '-'), sequence.end());
+            garbage_sequences.push_back(std::move(sequence));
+        } else {
+            profile_sequences.push_back(std::move(sequences[i]));
+        }
+    }
+    for (size_t row : garbage_index) {
+        gap_index.remove_row(row);
+    }
+    remove_all_gap_columns(profile_sequences, gap_index);
+    // Compaction copies the rows to new buffers
+    placement.apply(profile_sequences);
+}
+
+// Choose the star among the profile rows left in gap_index, find its gap regions and realign
+// them, then refine for up to options.iterations passes. With a cache, the blocks of pass n are
+// scoped scope + "pass<n>". Returns the number of gap regions of the first pass.
+size_t realign_profile(const PipelineOptions &options, std::vector<std::string> &profile_sequences, const utils::GapIndex &gap_index,
+                       size_t sequence_count, BlockCache *cache = nullptr, const std::string &scope = "") {
+    report.begin_stage("star selection");
+    size_t star_index = find_star_index(gap_index, options.sample_rows);
+    std::string star_sequence = star_index >= profile_sequences.size() ? std::string() : profile_sequences[star_index];
+    logger.log(LOG_DEBUG, "star sequence: ", star_sequence);
+
+    report.begin_stage("region detection");
+    double distance = gap_region_distance(star_sequence, sequence_count);
+    std::vector<std::pair<int, int>> gap_regions = find_gap_regions_roughly(star_sequence, distance, options.min_region_length);
+
+    if (logger.enabled(LOG_INFO)) {
+        std::ostringstream regions_text;
+        for (const auto &region : gap_regions) {
+            regions_text << "(" << region.first << ", " << region.second << ") ";
+        }
+        logger.log(LOG_INFO, "Gap regions: ", regions_text.str());
+    }
+
+    report.begin_stage("realignment");
+    if (gap_regions.empty()) {
+        logger.log(LOG_INFO, "No bad blocks to realign.");
+    } else {
+        RegionPass first_pass;
+        if (cache) {
+            cache->scope = scope + "pass1";
+        }
+        profile_sequences = realign_regions(options.msa, profile_sequences, gap_regions, &first_pass, cache);
+        logger.log(LOG_INFO, "Pass 1 SP gain: ", first_pass.sp_gain);
+        if (options.iterations != 1) {
+            refine_passes(options.msa, profile_sequences, star_index, distance, options.min_region_length, std::move(first_pass),
+                          options.iterations, options.min_gain, cache, scope);
+        }
+        prefilter.log_summary();
+        approximate_score.log_summary();
+    }
+    return gap_regions.size();
+}
+
+// Add the garbage rows to realigned_profile and leave the result in output_file: clustered
+// with a cluster distance, one at a time (resuming from checkpoint) otherwise
+void merge_garbage(const PipelineOptions &options, const std::vector<std::string> &garbage_identifications, const std::vector<std::string> &garbage_sequences,
+                   const std::string &realigned_profile, const std::string &output_file, Checkpoint *checkpoint = nullptr) {
+    if (options.garbage_cluster_distance > 0) {
+        merge_garbage_clusters(options.msa, garbage_identifications, garbage_sequences, realigned_profile, output_file, options.garbage_cluster_distance);
+    } else {
+        merge_garbage_sequences(options.msa, garbage_identifications, garbage_sequences, realigned_profile, output_file, checkpoint);
+    }
+}
+
+#endif //REFINE_STAR_PIPELINE_H
@@ -0,0 +1,206 @@
+#ifndef REFINE_STAR_PLACEMENT_H
+#define REFINE_STAR_PLACEMENT_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "Report.h"
+
+#ifndef MADV_COLLAPSE
+#define MADV_COLLAPSE 25
+#endif
+
+// Placement of the resident alignment in memory. Whenever rows are (re)built, that is once they
+// are loaded, once the profile is compacted and after every realignment pass, the pages holding
+// them are advised for transparent huge pages (or collapsed into huge pages right away) and
+// bound to the NUMA nodes, interleaved page by page or partitioned by rows, with the existing
+// pages moved. Worker threads are then pinned to the CPUs of a node, round robin, so that the
+// threads of each node share its memory bandwidth; under partitioning a worker prefers the rows
+// of its own node. Policies are applied with madvise and the mbind system call, so nothing is
+// linked in; on a machine with one node the NUMA policy does nothing.
+class MemoryPlacement {
+public:
+    enum HugePages { HUGE_PAGES_OFF, HUGE_PAGES_TRANSPARENT, HUGE_PAGES_COLLAPSE };
+    enum Numa { NUMA_OFF, NUMA_INTERLEAVE, NUMA_PARTITION };
+
+private:
+    static constexpr int MPOL_BIND_MODE = 2;
+    static constexpr int MPOL_INTERLEAVE_MODE = 3;
+    static constexpr unsigned MPOL_MOVE_FLAG = 1 << 1;
+
+    std::vector<std::vector<int>> node_cpus;
+    bool nodes_read = false;
+    size_t advised_total = 0;
+    size_t bound_total = 0;
+    size_t failed_total = 0;
+    unsigned applied = 0;
+
+    // CPUs of every node with CPUs, from /sys/devices/system/node/node<n>/cpulist (e.g. "0-3,8-11")
+    const std::vector<std::vector<int>> &nodes() {
+        if (nodes_read) return node_cpus;
+        nodes_read = true;
+        for (int node = 0; node < 64; ++node) {
+            std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            if (!file) continue;
+            std::string list;
+            std::getline(file, list);
+            std::vector<int> cpus;
+            std::istringstream ranges(list);
+            for (std::string range; std::getline(ranges, range, ','); ) {
+                int first = 0, last = 0;
+                const int fields = sscanf(range.c_str(), "%d-%d", &first, &last);
+                if (fields < 1) continue;
+                for (int cpu = first; cpu <= (fields == 2 ? last : first); ++cpu) cpus.push_back(cpu);
+            }
+            if (!cpus.empty()) {
+                node_cpus.resize(node + 1);
+                node_cpus[node] = std::move(cpus);
+            }
+        }
+        return node_cpus;
+    }
+
+    // Page-aligned address ranges covering the buffers of rows [first, last); buffers less than
+    // a page apart, as consecutive heap allocations are, share a range
+    static std::vector<std::pair<uintptr_t, uintptr_t>> row_spans(const std::vector<std::string> &rows, size_t first, size_t last) {
+        const uintptr_t page = sysconf(_SC_PAGESIZE);
+        std::vector<std::pair<uintptr_t, uintptr_t>> buffers;
+        for (size_t i = first; i < last; ++i) {
+            const uintptr_t begin = reinterpret_cast<uintptr_t>(rows[i].data());
+            buffers.emplace_back(begin, begin + rows[i].capacity() + 1);
+        }
+        std::sort(buffers.begin(), buffers.end());
+        std::vector<std::pair<uintptr_t, uintptr_t>> spans;
+        for (const auto &[begin, end] : buffers) {
+            if (!spans.empty() && begin < spans.back().second + page) {
+                spans.back().second = std::max(spans.back().second, end);
+            } else {
+                spans.emplace_back(begin, end);
+            }
+        }
+        for (auto &[begin, end] : spans) {
+            begin &= ~(page - 1);
+            end = (end + page - 1) & ~(page - 1);
+        }
+        return spans;
+    }
+
+    static bool bind(uintptr_t begin, uintptr_t end, int mode, unsigned long node_mask, size_t node_count) {
+        return syscall(SYS_mbind, begin, end - begin, mode, &node_mask, node_count + 1, MPOL_MOVE_FLAG) == 0;
+    }
+
+public:
+    HugePages huge_pages = HUGE_PAGES_OFF;
+    Numa numa = NUMA_OFF;
+
+    // Select a policy by its name ('off', 'thp' or 'collapse'; 'off', 'interleave' or
+    // 'partition'); false if the text is not one
+    bool select_huge_pages(const std::string &value) {
+        if (value == "off") huge_pages = HUGE_PAGES_OFF;
+        else if (value == "thp") huge_pages = HUGE_PAGES_TRANSPARENT;
+        else if (value == "collapse") huge_pages = HUGE_PAGES_COLLAPSE;
+        else return false;
+        return true;
+    }
+
+    bool select_numa(const std::string &value) {
+        if (value == "off") numa = NUMA_OFF;
+        else if (value == "interleave") numa = NUMA_INTERLEAVE;
+        else if (value == "partition") numa = NUMA_PARTITION;
+        else return false;
+        // Read the nodes now, before worker threads look them up
+        nodes();
+        return true;
+    }
+
+    bool enabled() const { return huge_pages != HUGE_PAGES_OFF || numa != NUMA_OFF; }
+
+    // Number of row partitions: the nodes under partitioning, 1 otherwise
+    size_t partitions() {
+        return numa == NUMA_PARTITION && nodes().size() > 1 ? nodes().size() : 1;
+    }
+
+    // Apply the policies to the pages holding rows, which replace those of the previous call
+    void apply(const std::vector<std::string> &rows) {
+        if (!enabled() || rows.empty()) return;
+        size_t advised = 0, bound = 0, failed = 0;
+        const size_t parts = partitions();
+        for (size_t part = 0; part < parts; ++part) {
+            for (const auto &[begin, end] : row_spans(rows, rows.size() * part / parts, rows.size() * (part + 1) / parts)) {
+                void *address = reinterpret_cast<void *>(begin);
+                if (huge_pages != HUGE_PAGES_OFF) {
+                    // Collapsing needs the range advised first, and fails harmlessly on a kernel without it
+                    if (madvise(address, end - begin, MADV_HUGEPAGE) == 0) {
+                        advised += end - begin;
+                        if (huge_pages == HUGE_PAGES_COLLAPSE) madvise(address, end - begin, MADV_COLLAPSE);
+                    } else {
+                        ++failed;
+                    }
+                }
+                if (numa != NUMA_OFF && nodes().size() > 1) {
+                    unsigned long mask = 0;
+                    if (numa == NUMA_INTERLEAVE) {
+                        for (size_t node = 0; node < nodes().size(); ++node) {
+                            if (!nodes()[node].empty()) mask |= 1UL << node;
+                        }
+                    } else {
+                        mask = 1UL << part;
+                    }
+                    if (bind(begin, end, numa == NUMA_INTERLEAVE ? MPOL_INTERLEAVE_MODE : MPOL_BIND_MODE, mask, nodes().size())) {
+                        bound += end - begin;
+                    } else {
+                        ++failed;
+                    }
+                }
+            }
+        }
+        logger.log(LOG_DEBUG, "Memory placement of ", rows.size(), " rows: ", advised >> 20, " MB advised for huge pages, ", bound >> 20, " MB bound over ",
+                   nodes().size(), " NUMA node(s)", failed ? " (some ranges failed: " + std::string(strerror(errno)) + ")" : "");
+        advised_total = std::max(advised_total, advised);
+        bound_total = std::max(bound_total, bound);
+        failed_total += failed;
+        ++applied;
+    }
+
+    // Largest placement of the rows over the run
+    void log_summary() {
+        if (applied == 0) return;
+        logger.log(LOG_INFO, "Memory placement: ", advised_total >> 20, " MB advised for huge pages, ", bound_total >> 20, " MB bound over ",
+                   nodes().size(), " NUMA node(s), rows placed ", applied, " times", failed_total ? ", some ranges failed" : "");
+        report.set_info("placement_huge_pages_mb", std::to_string(advised_total >> 20));
+        report.set_info("placement_numa_mb", std::to_string(bound_total >> 20));
+    }
+
+    // Node of a worker: round robin over the nodes, 0 without a NUMA policy. Worker threads call
+    // this, so the node table is only looked up once select_numa has read it
+    size_t node_of_worker(size_t worker) {
+        if (numa == NUMA_OFF) return 0;
+        return nodes().empty() ? 0 : worker % nodes().size();
+    }
+
+    // Pin the calling thread, worker number worker, to the CPUs of its node
+    void pin_worker(size_t worker) {
+        if (numa == NUMA_OFF || nodes().size() < 2) return;
+        const std::vector<int> &cpus = nodes()[node_of_worker(worker)];
+        if (cpus.empty()) return;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpus) CPU_SET(cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+};
+
+extern MemoryPlacement placement;
+
+#endif //REFINE_STAR_PLACEMENT_H
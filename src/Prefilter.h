@@ -0,0 +1,164 @@
+#ifndef REFINE_STAR_PREFILTER_H
+#define REFINE_STAR_PREFILTER_H
+
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <string>
+#include <vector>
+#include "Report.h"
+#include "Scoring.h"
+
+// Pairwise scores of the selected scoring scheme, without the gap opening term
+long long pair_score(char x, char y) {
+    return scoring.weights()(x, y);
+}
+
+// Score of the pairwise alignment that rows x and y induce in a block
+long long induced_pair_score(const std::string &x, const std::string &y) {
+    long long s = 0;
+    for (size_t j = 0; j < x.size(); ++j) {
+        s += pair_score(x[j], y[j]);
+    }
+    return s;
+}
+
+// Needleman-Wunsch score of x and y with linear gaps, restricted to a band of radius
+// |len(x) - len(y)| + band around the diagonal; *exact is set when the band covers the matrix
+long long banded_pair_score(const std::string &x, const std::string &y, size_t band, bool *exact) {
+    const long long gap = scoring.weights().gap();
+    const long long minus_infinity = -(1LL << 50);
+    const size_t n = x.size();
+    const size_t m = y.size();
+    const size_t radius = (n > m ? n - m : m - n) + band;
+    *exact = radius >= std::max(n, m);
+
+    std::vector<long long> previous(m + 1, minus_infinity), current(m + 1, minus_infinity);
+    for (size_t j = 0; j <= std::min(m, radius); ++j) previous[j] = gap * static_cast<long long>(j);
+    for (size_t i = 1; i <= n; ++i) {
+        const size_t lo = i > radius ? i - radius : 0;
+        const size_t hi = std::min(m, i + radius);
+        std::fill(current.begin(), current.end(), minus_infinity);
+        if (lo == 0) current[0] = gap * static_cast<long long>(i);
+        for (size_t j = std::max<size_t>(lo, 1); j <= hi; ++j) {
+            long long best = previous[j - 1] + pair_score(x[i - 1], y[j - 1]);
+            best = std::max(best, previous[j] + gap);
+            best = std::max(best, current[j - 1] + gap);
+            current[j] = best;
+        }
+        std::swap(previous, current);
+    }
+    return previous[m];
+}
+
+// Screen run before a block is handed to the aligner. Level 1 only skips blocks that provably
+// cannot gain: the non-empty rows are already identical, or every pair of rows is already
+// aligned optimally (so the SP score is at its pairwise upper bound). Level 2 also skips
+// blocks without any internal gap and blocks where a banded realignment of a sample of row
+// pairs finds no gain. In audit mode the skipped blocks are still realigned, to count how
+// many of them the aligner would have improved.
+class Prefilter {
+private:
+    std::atomic<unsigned long> screened{0};
+    std::atomic<unsigned long> skipped{0};
+    std::atomic<unsigned long> audited{0};
+    std::atomic<unsigned long> missed{0};
+
+public:
+    int level = 1;
+    bool audit = false;
+    size_t sample_pairs = 64;
+    size_t band = 32;
+
+    // Why the block should not be realigned, or nullptr
+    const char *reject_reason(const std::vector<std::string> &block, const std::vector<std::string> &ungapped) {
+        if (level <= 0) return nullptr;
+        ++screened;
+
+        std::vector<size_t> rows;
+        for (size_t i = 0; i < ungapped.size(); ++i) {
+            if (!ungapped[i].empty()) rows.push_back(i);
+        }
+        const char *reason = nullptr;
+        if (rows.size() < 2 || std::all_of(rows.begin(), rows.end(), [&](size_t i) { return block[i] == block[rows[0]]; })) {
+            reason = "identical rows";
+        } else if (level >= 2 && gap_consistent(block, rows)) {
+            reason = "no internal gaps";
+        } else {
+            reason = pair_bound(block, ungapped, rows);
+        }
+        if (reason) ++skipped;
+        return reason;
+    }
+
+    void record_audit(bool would_improve) {
+        ++audited;
+        if (would_improve) ++missed;
+    }
+
+    void log_summary() {
+        if (screened == 0) return;
+        logger.log(LOG_INFO, "Pre-filter: skipped ", skipped.load(), " of ", screened.load(), " blocks (",
+                   100.0 * skipped / screened, "%)");
+        if (audited > 0) {
+            logger.log(LOG_INFO, "Pre-filter audit: ", missed.load(), " of ", audited.load(), " skipped blocks would have improved");
+        }
+        report.set_info("prefilter_screened", std::to_string(screened.load()));
+        report.set_info("prefilter_skipped", std::to_string(skipped.load()));
+        if (audited > 0) {
+            report.set_info("prefilter_missed", std::to_string(missed.load()));
+        }
+    }
+
+private:
+    // Every column is either all gaps or gap-free among the non-empty rows
+    static bool gap_consistent(const std::vector<std::string> &block, const std::vector<size_t> &rows) {
+        for (size_t j = 0; j < block[rows[0]].size(); ++j) {
+            const bool gap = block[rows[0]][j] == '-';
+            for (size_t i : rows) {
+                if ((block[i][j] == '-') != gap) return false;
+            }
+        }
+        return true;
+    }
+
+    // The SP score of a block is at most the sum of the pairwise optima; when no row pair can
+    // be aligned better than it already is, realignment cannot gain. With all pairs and a full
+    // band this is exact (level 1), otherwise it is an estimate (level 2). Under an affine
+    // scheme the bound leaves out the gap openings, which realignment may still reduce, so it is
+    // never exact.
+    const char *pair_bound(const std::vector<std::string> &block, const std::vector<std::string> &ungapped, const std::vector<size_t> &rows) {
+        const size_t pair_count = rows.size() * (rows.size() - 1) / 2;
+        const bool all_pairs = pair_count <= sample_pairs;
+        if ((!all_pairs || scoring.affine()) && level < 2) return nullptr;
+
+        std::mt19937 generator(static_cast<unsigned>(rows.size() * 2654435761u + block[rows[0]].size()));
+        std::uniform_int_distribution<size_t> pick(0, rows.size() - 1);
+        bool exact = all_pairs && !scoring.affine();
+        for (size_t k = 0; k < std::min(pair_count, sample_pairs); ++k) {
+            size_t x, y;
+            if (all_pairs) {
+                // k-th pair (x, y) with x < y
+                x = 0;
+                size_t rest = k;
+                while (rest >= rows.size() - 1 - x) rest -= rows.size() - 1 - x++;
+                y = x + 1 + rest;
+            } else {
+                do {
+                    x = pick(generator);
+                    y = pick(generator);
+                } while (x == y);
+            }
+            bool full_band;
+            const long long best = banded_pair_score(ungapped[rows[x]], ungapped[rows[y]], band, &full_band);
+            exact = exact && full_band;
+            if (best > induced_pair_score(block[rows[x]], block[rows[y]])) return nullptr;
+        }
+        if (!exact && level < 2) return nullptr;
+        return exact ? "pairs optimal" : "no sampled pair gain";
+    }
+};
+
+extern Prefilter prefilter;
+
+#endif //REFINE_STAR_PREFILTER_H
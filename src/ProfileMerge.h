@@ -0,0 +1,132 @@
+#ifndef REFINE_STAR_PROFILEMERGE_H
+#define REFINE_STAR_PROFILEMERGE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "CenterStar.h"
+#include "Checkpoint.h"
+#include "Fasta.h"
+#include "Kmer.h"
+#include "Mock.h"
+#include "Placement.h"
+#include "Report.h"
+
+extern std::string tmp_folder;
+extern unsigned thread_count;
+
+// Path to profileAlignment.jar in the install directory
+std::string profile_aligner_path() {
+    return std::string(std::getenv("HOME")) + "/.realign_star/bin/profileAlignment.jar";
+}
+
+// The mock backend merges in-process and does not need the jar
+bool profile_aligner_available(const std::string &msa) {
+    if (msa == "mock") {
+        return true;
+    }
+    std::ifstream jar_file(profile_aligner_path());
+    return jar_file.good();
+}
+
+// Add the garbage sequences to realigned_profile one at a time; the last merge is left in output_file.
+// With a checkpoint, the sequences already merged by a previous run are skipped.
+void merge_garbage_sequences(const std::string &msa, const std::vector<std::string> &garbage_identifications, const std::vector<std::string> &garbage_sequences,
+                             const std::string &realigned_profile, const std::string &output_file, Checkpoint *checkpoint = nullptr) {
+    const std::string jar_path = profile_aligner_path();
+    const std::string garbage_file = tmp_folder + "/current_bad_sequence.fasta";
+
+    utils::Fasta garbages;
+    garbages.identifications.resize(1, "");
+    garbages.sequences.resize(1, "");
+
+    size_t first = 0;
+    if (checkpoint) {
+        first = std::min(checkpoint->resume_merge(realigned_profile), garbage_identifications.size());
+        if (first == garbage_identifications.size()) {
+            std::filesystem::copy_file(realigned_profile, output_file, std::filesystem::copy_options::overwrite_existing);
+        }
+    }
+
+    for (size_t k = first; k < garbage_identifications.size(); k++) {
+        garbages.identifications[0] = garbage_identifications[k];
+        garbages.sequences[0] = garbage_sequences[k];
+        std::ofstream garbage_path(garbage_file);
+        garbages.write_to(garbage_path);
+        garbage_path.close();
+
+        if (msa == "mock") {
+            mock_profile_merge(garbage_file, realigned_profile, output_file);
+        } else {
+            std::string command_profile_to_seq = "java -jar " + jar_path + " -i " + garbage_file + " " + realigned_profile +" -o " + output_file + " 2> /dev/null";
+            system(command_profile_to_seq.c_str());
+        }
+        std::filesystem::copy_file(output_file, realigned_profile, std::filesystem::copy_options::overwrite_existing);
+        if (checkpoint) {
+            checkpoint->save_merge(k + 1, realigned_profile, k + 1 == garbage_identifications.size());
+        }
+    }
+}
+
+// Add the garbage sequences to realigned_profile with a single profile-profile alignment: they
+// are clustered by k-mer distance (a cluster's members are within max_distance of its leader),
+// every cluster is center-star aligned on its leader, up to thread_count clusters at a time, and
+// the clusters are center-star merged on the leader of the largest one into the garbage profile.
+void merge_garbage_clusters(const std::string &msa, const std::vector<std::string> &garbage_identifications, const std::vector<std::string> &garbage_sequences,
+                            const std::string &realigned_profile, const std::string &output_file, double max_distance) {
+    const std::vector<std::vector<size_t>> clusters = cluster_by_kmers(garbage_sequences, max_distance);
+    logger.log(LOG_INFO, "Garbage clusters: ", clusters.size());
+
+    std::vector<AlignedGroup> groups(clusters.size());
+    std::atomic<size_t> next_cluster{0};
+    auto worker = [&](unsigned t) {
+        placement.pin_worker(t);
+        for (size_t c; (c = next_cluster++) < clusters.size(); ) {
+            std::vector<AlignedGroup> members;
+            for (size_t i : clusters[c]) {
+                members.push_back({{garbage_sequences[i]}, 0});
+            }
+            groups[c].rows = center_star_merge(garbage_sequences[clusters[c][0]], members);
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < std::max(1u, thread_count) && t < clusters.size(); ++t) {
+        workers.emplace_back(worker, t);
+    }
+    for (auto &t : workers) {
+        t.join();
+    }
+
+    size_t largest = 0;
+    for (size_t c = 1; c < clusters.size(); ++c) {
+        if (clusters[c].size() > clusters[largest].size()) largest = c;
+    }
+    std::vector<std::string> rows = center_star_merge(garbage_sequences[clusters[largest][0]], groups);
+
+    // Back to the order of the garbage sequences
+    utils::Fasta garbage_profile;
+    garbage_profile.identifications = garbage_identifications;
+    garbage_profile.sequences.resize(garbage_sequences.size());
+    size_t r = 0;
+    for (const auto &cluster : clusters) {
+        for (size_t i : cluster) {
+            garbage_profile.sequences[i] = std::move(rows[r++]);
+        }
+    }
+    const std::string garbage_file = tmp_folder + "/garbage_profile.fasta";
+    write_fasta(garbage_file, garbage_profile);
+
+    if (msa == "mock") {
+        mock_profile_merge(garbage_file, realigned_profile, output_file);
+    } else {
+        std::string command_profile_to_profile = "java -jar " + profile_aligner_path() + " -i " + garbage_file + " " + realigned_profile + " -o " + output_file + " 2> /dev/null";
+        system(command_profile_to_profile.c_str());
+    }
+}
+
+#endif //REFINE_STAR_PROFILEMERGE_H
@@ -0,0 +1,310 @@
+#ifndef REFINE_STAR_REMOTE_H
+#define REFINE_STAR_REMOTE_H
+
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "AlignerPolicy.h"
+#include "Report.h"
+
+extern std::string tmp_folder;
+
+// Block jobs travel between a coordinator and its workers over TCP as frames: an 8-byte
+// big-endian payload length followed by the payload.
+//   request:  "ALIGN <msa> <rows> <columns>\n" followed by the unaligned block as FASTA
+//   response: "OK <threads> <estimated_bytes> <peak_rss_kb> <seconds>\n<arguments>\n" followed
+//             by the aligned block as FASTA (empty if the aligner failed), or "ERROR <reason>\n"
+//             for a request the worker refuses
+
+bool write_all(int fd, const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t written = send(fd, data, size, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+bool read_all(int fd, char *data, size_t size) {
+    while (size > 0) {
+        ssize_t got = recv(fd, data, size, 0);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        data += got;
+        size -= got;
+    }
+    return true;
+}
+
+bool send_frame(int fd, const std::string &payload) {
+    unsigned char prefix[8];
+    for (int k = 0; k < 8; ++k) prefix[k] = static_cast<unsigned char>(static_cast<uint64_t>(payload.size()) >> (56 - 8 * k));
+    return write_all(fd, reinterpret_cast<const char *>(prefix), 8) && write_all(fd, payload.data(), payload.size());
+}
+
+// Largest payload accepted; a larger length is not a block job (e.g. a stray HTTP request read
+// as a length) and ends the connection before anything is allocated
+constexpr uint64_t max_frame_bytes = 4ULL << 30;
+
+bool receive_frame(int fd, std::string &payload) {
+    unsigned char prefix[8];
+    if (!read_all(fd, reinterpret_cast<char *>(prefix), 8)) return false;
+    uint64_t size = 0;
+    for (int k = 0; k < 8; ++k) size = size << 8 | prefix[k];
+    if (size > max_frame_bytes) {
+        logger.log(LOG_INFO, "** Frame of ", size, " bytes exceeds the limit of ", max_frame_bytes, ", closing the connection");
+        return false;
+    }
+    payload.resize(size);
+    return read_all(fd, &payload[0], size);
+}
+
+std::string read_file(const std::string &file_path) {
+    std::ifstream ifs(file_path, std::ios::binary);
+    std::ostringstream content;
+    content << ifs.rdbuf();
+    return content.str();
+}
+
+// Split "host:port" (or a bare port, meaning the loopback address) into its parts
+std::pair<std::string, std::string> split_address(const std::string &address) {
+    const size_t colon = address.rfind(':');
+    if (colon == std::string::npos) return {"", address};
+    return {address.substr(0, colon), address.substr(colon + 1)};
+}
+
+// Connect to, or with listening set bind a listening socket on, host:port; -1 on failure. A
+// missing host is the loopback address; a listener takes every interface only when asked
+// with host "*" (or an address such as 0.0.0.0)
+int open_socket(const std::string &address, bool listening) {
+    auto [host, port] = split_address(address);
+    const bool every_interface = listening && host == "*";
+    struct addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = every_interface ? AI_PASSIVE : 0;
+    struct addrinfo *addresses = nullptr;
+    if (listening && host.empty()) host = "127.0.0.1";
+    if (getaddrinfo(host.empty() || every_interface ? nullptr : host.c_str(), port.c_str(), &hints, &addresses) != 0) {
+        return -1;
+    }
+    int fd = -1;
+    for (struct addrinfo *a = addresses; a && fd < 0; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd < 0) continue;
+        int one = 1;
+        bool ok;
+        if (listening) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            ok = bind(fd, a->ai_addr, a->ai_addrlen) == 0 && listen(fd, 64) == 0;
+        } else {
+            ok = connect(fd, a->ai_addr, a->ai_addrlen) == 0;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+        if (!ok) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+    return fd;
+}
+
+// Connections of the coordinator to its workers, one job at a time on each. A worker that
+// cannot be reached or drops its connection is retired and its jobs run locally instead.
+class RemoteWorkers {
+private:
+    struct Endpoint {
+        std::string address;
+        int fd = -1;
+        bool busy = false;
+        bool dead = false;
+    };
+
+    std::vector<Endpoint> endpoints;
+    std::mutex mutex;
+    std::condition_variable idle;
+
+    // An idle live endpoint, waiting while all live ones are busy; -1 once none is left
+    int acquire() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            bool alive = false;
+            for (size_t k = 0; k < endpoints.size(); ++k) {
+                if (endpoints[k].dead) continue;
+                alive = true;
+                if (!endpoints[k].busy) {
+                    endpoints[k].busy = true;
+                    return k;
+                }
+            }
+            if (!alive) return -1;
+            idle.wait(lock);
+        }
+    }
+
+    void release(int k, bool failed) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            Endpoint &endpoint = endpoints[k];
+            endpoint.busy = false;
+            if (failed) {
+                if (endpoint.fd >= 0) close(endpoint.fd);
+                endpoint.fd = -1;
+                endpoint.dead = true;
+            }
+        }
+        idle.notify_all();
+    }
+
+public:
+    // Comma-separated host:port list; list a worker twice to keep two jobs in flight on it
+    void configure(const std::string &addresses) {
+        std::stringstream list(addresses);
+        std::string address;
+        while (std::getline(list, address, ',')) {
+            if (!address.empty()) endpoints.push_back({address});
+        }
+    }
+
+    bool enabled() const { return !endpoints.empty(); }
+    size_t slots() const { return endpoints.size(); }
+
+    // Align raw_tmp into aligned_tmp on a worker; false if no worker could do it
+    bool align(const std::string &msa, size_t rows, size_t columns, const std::string &raw_tmp, const std::string &aligned_tmp, AlignerRun *run) {
+        int k;
+        while ((k = acquire()) >= 0) {
+            Endpoint &endpoint = endpoints[k];
+            if (endpoint.fd < 0) {
+                endpoint.fd = open_socket(endpoint.address, false);
+            }
+            std::string response;
+            const std::string request = "ALIGN " + msa + " " + std::to_string(rows) + " " + std::to_string(columns) + "\n" + read_file(raw_tmp);
+            if (endpoint.fd >= 0 && send_frame(endpoint.fd, request) && receive_frame(endpoint.fd, response)) {
+                const size_t status_end = response.find('\n');
+                const size_t arguments_end = response.find('\n', status_end + 1);
+                std::istringstream status(response.substr(0, status_end));
+                std::string ok;
+                status >> ok >> run->threads >> run->estimated_bytes >> run->peak_rss_kb >> run->seconds;
+                if (ok == "OK" && arguments_end != std::string::npos) {
+                    run->arguments = response.substr(status_end + 1, arguments_end - status_end - 1);
+                    std::ofstream ofs(aligned_tmp, std::ios::binary);
+                    ofs.write(response.data() + arguments_end + 1, response.size() - arguments_end - 1);
+                    ofs.close();
+                    release(k, false);
+                    return true;
+                }
+            }
+            logger.log(LOG_INFO, "** Worker ", endpoint.address, " failed, its jobs now run elsewhere");
+            release(k, true);
+        }
+        return false;
+    }
+};
+
+extern RemoteWorkers remote_workers;
+
+volatile std::sig_atomic_t stop_requested = 0;
+
+// Serve block jobs on address until SIGINT or SIGTERM; every connection gets its own thread,
+// which closes it when the coordinator goes away, and align runs a job from its unaligned file
+// into its aligned file. Jobs are not authenticated and run the aligners on whatever they carry,
+// so the worker listens on the loopback address unless a host is given, and should only be
+// exposed on a trusted network.
+int serve_worker(const std::string &address, const std::function<AlignerRun(const std::string &, size_t, size_t, const std::string &, const std::string &)> &align) {
+    int listener = open_socket(address, true);
+    if (listener < 0) {
+        std::cerr << "** Error: cannot listen on " << address << "." << std::endl;
+        return 1;
+    }
+    struct sigaction action = {};
+    action.sa_handler = [](int) { stop_requested = 1; };
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    logger.log(LOG_INFO, "Worker listening on ", address);
+    logger.flush();
+
+    std::mutex connections_mutex;
+    std::condition_variable connection_closed;
+    std::set<int> connections;
+    std::atomic<unsigned> job_counter{0};
+
+    auto serve = [&](int fd) {
+        std::string request;
+        while (receive_frame(fd, request)) {
+            const size_t header_end = request.find('\n');
+            std::istringstream header(request.substr(0, header_end));
+            std::string command, msa;
+            size_t rows = 0, columns = 0;
+            header >> command >> msa >> rows >> columns;
+            if (command != "ALIGN" || header_end == std::string::npos) break;
+            if (!is_supported_msa(msa)) {
+                logger.log(LOG_INFO, "** Worker job refused: unsupported msa ", msa);
+                if (!send_frame(fd, "ERROR unsupported msa " + msa + "\n")) break;
+                continue;
+            }
+
+            const std::string job_name = tmp_folder + "/remote_" + std::to_string(job_counter++);
+            const std::string raw_tmp = job_name + ".fasta";
+            const std::string aligned_tmp = job_name + ".aligned";
+            {
+                std::ofstream ofs(raw_tmp, std::ios::binary);
+                ofs.write(request.data() + header_end + 1, request.size() - header_end - 1);
+            }
+            AlignerRun run = align(msa, rows, columns, raw_tmp, aligned_tmp);
+            const std::string response = "OK " + std::to_string(run.threads) + " " + std::to_string(run.estimated_bytes) + " " + std::to_string(run.peak_rss_kb)
+                                         + " " + std::to_string(run.seconds) + "\n" + run.arguments + "\n" + read_file(aligned_tmp);
+            std::filesystem::remove(raw_tmp);
+            std::filesystem::remove(aligned_tmp);
+            logger.log(LOG_INFO, "Worker job: ", rows, " x ", columns, " ", msa, " ", run.arguments, " in ", run.seconds, " s");
+            logger.flush();
+            if (!send_frame(fd, response)) break;
+        }
+        // Closed under the lock, so that shutdown below never reaches a reused descriptor
+        std::lock_guard<std::mutex> lock(connections_mutex);
+        connections.erase(fd);
+        close(fd);
+        connection_closed.notify_all();
+    };
+
+    while (!stop_requested) {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        std::lock_guard<std::mutex> lock(connections_mutex);
+        connections.insert(fd);
+        std::thread(serve, fd).detach();
+    }
+
+    close(listener);
+    std::unique_lock<std::mutex> lock(connections_mutex);
+    for (int fd : connections) shutdown(fd, SHUT_RDWR);
+    connection_closed.wait(lock, [&] { return connections.empty(); });
+    logger.log(LOG_INFO, "Worker stopped");
+    return 0;
+}
+
+#endif //REFINE_STAR_REMOTE_H
@@ -0,0 +1,216 @@
+#ifndef REFINE_STAR_REPORT_H
+#define REFINE_STAR_REPORT_H
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <sys/resource.h>
+
+// Console verbosity levels
+enum LogLevel {
+    LOG_QUIET = 0,
+    LOG_INFO  = 1,
+    LOG_DEBUG = 2
+};
+
+// Buffered console logger, flushed when the buffer grows large and on exit; safe to call from worker threads
+class Logger {
+private:
+    static constexpr std::streamoff flush_threshold = 1 << 16;
+
+    int level = LOG_INFO;
+    std::ostringstream buffer;
+    std::mutex mutex;
+
+public:
+    ~Logger() {
+        flush();
+    }
+
+    void set_level(int new_level) {
+        level = new_level;
+    }
+
+    bool enabled(int message_level) const {
+        return message_level <= level;
+    }
+
+    template<typename... Args>
+    void log(int message_level, const Args &... args) {
+        if (!enabled(message_level)) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        (buffer << ... << args) << '\n';
+        if (buffer.tellp() > flush_threshold) flush_locked();
+    }
+
+    void flush() {
+        std::lock_guard<std::mutex> lock(mutex);
+        flush_locked();
+    }
+
+private:
+    void flush_locked() {
+        std::cout << buffer.str();
+        std::cout.flush();
+        buffer.str("");
+    }
+};
+
+// Per-block counters collected by realign_block
+struct BlockRecord {
+    int start;
+    int end;
+    size_t rows;
+    size_t columns;
+    double aligner_seconds;
+    long long sp_before;
+    long long sp_after;
+    bool accepted;
+    long estimated_rss_kb;
+    long peak_rss_kb;
+    std::string aligner_arguments;
+    unsigned aligner_threads;
+};
+
+// Per-stage timers, per-block counters and peak RSS of a run
+class Report {
+private:
+    using clock = std::chrono::steady_clock;
+
+    std::vector<std::pair<std::string, double>> stages;
+    std::vector<std::pair<std::string, std::string>> info;
+    std::string current_stage;
+    clock::time_point stage_start;
+    std::mutex blocks_mutex;
+    clock::time_point run_start = clock::now();
+
+    static std::string escape(const std::string &s) {
+        std::string escaped;
+        for (char c : s) {
+            if (c == '"' || c == '\\') escaped += '\\';
+            escaped += c;
+        }
+        return escaped;
+    }
+
+    // A CSV field per RFC 4180: quoted, with its quotes doubled, if it holds a comma, a quote or a line break
+    static std::string csv_field(const std::string &text) {
+        if (text.find_first_of(",\"\r\n") == std::string::npos) return text;
+        std::string quoted = "\"";
+        for (char c : text) {
+            if (c == '"') quoted += '"';
+            quoted += c;
+        }
+        return quoted + '"';
+    }
+
+    // Peak resident set size in KB, of this process or of its largest child
+    static long peak_rss_kb(int who) {
+        struct rusage usage;
+        if (getrusage(who, &usage) != 0) return 0;
+        return usage.ru_maxrss;
+    }
+
+public:
+    std::vector<BlockRecord> blocks;
+
+    static double seconds_since(clock::time_point since) {
+        return std::chrono::duration<double>(clock::now() - since).count();
+    }
+
+    // Close the running stage (if any) and start timing a new one
+    void begin_stage(const std::string &name) {
+        end_stage();
+        current_stage = name;
+        stage_start = clock::now();
+    }
+
+    void end_stage() {
+        if (current_stage.empty()) return;
+        stages.emplace_back(current_stage, seconds_since(stage_start));
+        current_stage.clear();
+    }
+
+    void set_info(const std::string &key, const std::string &value) {
+        info.emplace_back(key, value);
+    }
+
+    void add_block(const BlockRecord &record) {
+        std::lock_guard<std::mutex> lock(blocks_mutex);
+        blocks.push_back(record);
+    }
+
+    void write_json(std::ostream &os) const {
+        os << "{\n";
+        for (const auto &[key, value] : info) {
+            os << "  \"" << escape(key) << "\": \"" << escape(value) << "\",\n";
+        }
+        os << "  \"total_seconds\": " << seconds_since(run_start) << ",\n";
+        os << "  \"peak_rss_kb\": " << peak_rss_kb(RUSAGE_SELF) << ",\n";
+        os << "  \"peak_child_rss_kb\": " << peak_rss_kb(RUSAGE_CHILDREN) << ",\n";
+        os << "  \"stages\": [";
+        for (size_t i = 0; i < stages.size(); ++i) {
+            os << (i ? ",\n" : "\n") << "    {\"name\": \"" << escape(stages[i].first) << "\", \"seconds\": " << stages[i].second << "}";
+        }
+        os << "\n  ],\n";
+        os << "  \"blocks\": [";
+        for (size_t i = 0; i < blocks.size(); ++i) {
+            const BlockRecord &b = blocks[i];
+            os << (i ? ",\n" : "\n") << "    {\"start\": " << b.start << ", \"end\": " << b.end
+               << ", \"rows\": " << b.rows << ", \"columns\": " << b.columns
+               << ", \"aligner_seconds\": " << b.aligner_seconds
+               << ", \"sp_before\": " << b.sp_before << ", \"sp_after\": " << b.sp_after
+               << ", \"sp_delta\": " << b.sp_after - b.sp_before
+               << ", \"accepted\": " << (b.accepted ? "true" : "false")
+               << ", \"estimated_rss_kb\": " << b.estimated_rss_kb << ", \"peak_rss_kb\": " << b.peak_rss_kb
+               << ", \"aligner_arguments\": \"" << escape(b.aligner_arguments) << "\", \"aligner_threads\": " << b.aligner_threads << "}";
+        }
+        os << "\n  ]\n";
+        os << "}\n";
+    }
+
+    // One row per info field, stage and block; for blocks the value is the aligner time
+    void write_csv(std::ostream &os) const {
+        os << "record,name,value,start,end,rows,columns,sp_before,sp_after,sp_delta,accepted,estimated_rss_kb,peak_rss_kb,aligner_arguments,aligner_threads\n";
+        for (const auto &[key, value] : info) {
+            os << "info," << csv_field(key) << "," << csv_field(value) << ",,,,,,,,,,,,\n";
+        }
+        os << "total,seconds," << seconds_since(run_start) << ",,,,,,,,,,,,\n";
+        os << "memory,peak_rss_kb," << peak_rss_kb(RUSAGE_SELF) << ",,,,,,,,,,,,\n";
+        os << "memory,peak_child_rss_kb," << peak_rss_kb(RUSAGE_CHILDREN) << ",,,,,,,,,,,,\n";
+        for (const auto &[name, seconds] : stages) {
+            os << "stage," << csv_field(name) << "," << seconds << ",,,,,,,,,,,,\n";
+        }
+        for (const BlockRecord &b : blocks) {
+            os << "block,aligner_seconds," << b.aligner_seconds << "," << b.start << "," << b.end << "," << b.rows << "," << b.columns
+               << "," << b.sp_before << "," << b.sp_after << "," << b.sp_after - b.sp_before << "," << (b.accepted ? 1 : 0)
+               << "," << b.estimated_rss_kb << "," << b.peak_rss_kb << "," << csv_field(b.aligner_arguments) << "," << b.aligner_threads << "\n";
+        }
+    }
+
+    // Write the report as CSV if the path ends with ".csv", JSON otherwise
+    void write_to(const std::string &path) {
+        end_stage();
+        std::ofstream ofs(path);
+        if (!ofs) {
+            std::cerr << "Error: cannot open report file " << path << std::endl;
+            return;
+        }
+        if (path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0) {
+            write_csv(ofs);
+        } else {
+            write_json(ofs);
+        }
+        ofs.close();
+    }
+};
+
+extern Logger logger;
+extern Report report;
+
+#endif //REFINE_STAR_REPORT_H
@@ -0,0 +1,126 @@
+#ifndef REFINE_STAR_SCHEDULER_H
+#define REFINE_STAR_SCHEDULER_H
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Memory and CPU budget shared by the concurrent aligner jobs. A job waits until its
+// estimated footprint and a core fit next to the running ones; a job larger than the whole
+// budget still runs, but alone.
+class ResourceBudget {
+private:
+    uint64_t memory_bytes = 0;
+    unsigned cpus = 1;
+    uint64_t memory_in_use = 0;
+    unsigned cpus_in_use = 0;
+    unsigned running = 0;
+    std::map<std::string, double> calibration;
+    std::mutex mutex;
+    std::condition_variable released;
+
+public:
+    void configure(uint64_t memory, unsigned cpu_count) {
+        std::lock_guard<std::mutex> lock(mutex);
+        memory_bytes = memory;
+        cpus = std::max(1u, cpu_count);
+    }
+
+    uint64_t memory_limit() const { return memory_bytes; }
+
+    // Address-space cap of every aligner process (0 for none). The budget itself is kept by
+    // admission and the measured peak RSS; an address-space cap is only set on request, since
+    // threaded and JVM-based aligners reserve far more virtual memory than they use.
+    uint64_t address_space_cap = 0;
+
+    // Wait for the memory and one core, then take up to max_cpus of the free cores; returns
+    // the number of cores taken, to be given back to release
+    unsigned acquire(uint64_t memory, unsigned max_cpus = 1) {
+        std::unique_lock<std::mutex> lock(mutex);
+        released.wait(lock, [&] {
+            return running == 0 || (memory_in_use + memory <= memory_bytes && cpus_in_use < cpus);
+        });
+        const unsigned cpu_count = std::max(1u, std::min(max_cpus, cpus > cpus_in_use ? cpus - cpus_in_use : 0));
+        memory_in_use += memory;
+        cpus_in_use += cpu_count;
+        ++running;
+        return cpu_count;
+    }
+
+    void release(uint64_t memory, unsigned cpu_count) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            memory_in_use -= memory;
+            cpus_in_use -= cpu_count;
+            --running;
+        }
+        released.notify_all();
+    }
+
+    // Footprint model of one aligner call on a rows x columns block, scaled up by the worst
+    // underestimate measured so far for that backend. The models are deliberately rough:
+    // mafft keeps a rows^2 distance matrix, muscle3 adds profile and tree matrices that grow
+    // even faster with rows, and halign3 starts a JVM.
+    uint64_t estimate(const std::string &msa, size_t rows, size_t columns) {
+        const double cells = static_cast<double>(rows) * columns;
+        const double pairs = static_cast<double>(rows) * rows;
+        double bytes;
+        if (msa == "mock") {
+            bytes = cells * 2;
+        } else if (msa == "mafft") {
+            bytes = 32e6 + cells * 8 + pairs * 8;
+        } else if (msa == "muscle3") {
+            bytes = 16e6 + cells * 32 + pairs * 24;
+        } else {
+            bytes = 256e6 + cells * 16 + pairs * 4;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = calibration.find(msa);
+        return static_cast<uint64_t>(bytes * (it == calibration.end() ? 1.0 : it->second));
+    }
+
+    // Record the measured peak of a job so that later estimates for the backend cover it
+    void observe(const std::string &msa, uint64_t estimated, uint64_t peak) {
+        if (estimated == 0 || peak <= estimated) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        double &ratio = calibration.emplace(msa, 1.0).first->second;
+        ratio = std::max(ratio, ratio * peak / estimated);
+    }
+};
+
+extern ResourceBudget budget;
+
+// Run command through /bin/sh with its address space capped at memory_limit bytes (0 for no
+// cap) and return its exit status; *peak_rss_kb receives the peak resident set of the child
+int run_limited(const std::string &command, uint64_t memory_limit, long *peak_rss_kb = nullptr) {
+    if (peak_rss_kb) *peak_rss_kb = 0;
+    pid_t pid = fork();
+    if (pid < 0) {
+        return -1;
+    }
+    if (pid == 0) {
+        if (memory_limit > 0) {
+            struct rlimit limit = {memory_limit, memory_limit};
+            setrlimit(RLIMIT_AS, &limit);
+        }
+        execl("/bin/sh", "sh", "-c", command.c_str(), static_cast<char *>(nullptr));
+        _exit(127);
+    }
+
+    int status = 0;
+    struct rusage usage;
+    while (wait4(pid, &status, 0, &usage) < 0) {
+        if (errno != EINTR) return -1;
+    }
+    if (peak_rss_kb) *peak_rss_kb = usage.ru_maxrss;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+#endif //REFINE_STAR_SCHEDULER_H
@@ -0,0 +1,238 @@
+#ifndef REFINE_STAR_SCORING_H
+#define REFINE_STAR_SCORING_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Symbol classes of the SP scoring: a, c, g, t (and u), other characters, gap
+enum SymbolClass { SYMBOL_A, SYMBOL_C, SYMBOL_G, SYMBOL_T, SYMBOL_N, SYMBOL_GAP, SYMBOL_CLASSES };
+
+struct SymbolTable {
+    uint8_t classes[256];
+
+    constexpr SymbolTable() : classes() {
+        for (int c = 0; c < 256; ++c) classes[c] = SYMBOL_N;
+        classes[static_cast<int>('a')] = classes[static_cast<int>('A')] = SYMBOL_A;
+        classes[static_cast<int>('c')] = classes[static_cast<int>('C')] = SYMBOL_C;
+        classes[static_cast<int>('g')] = classes[static_cast<int>('G')] = SYMBOL_G;
+        classes[static_cast<int>('t')] = classes[static_cast<int>('T')] = SYMBOL_T;
+        classes[static_cast<int>('u')] = classes[static_cast<int>('U')] = SYMBOL_T;
+        classes[static_cast<int>('-')] = SYMBOL_GAP;
+    }
+
+    uint8_t operator[](char c) const { return classes[static_cast<unsigned char>(c)]; }
+};
+
+constexpr SymbolTable symbol_classes;
+
+// Column counts of the scoring add one class to the symbol classes: a gap that opens in the
+// column (the row has no gap in the column before). Only affine schemes count it apart.
+constexpr size_t SCORE_GAP_OPEN = SYMBOL_CLASSES;
+constexpr size_t SCORE_CLASSES = SYMBOL_CLASSES + 1;
+
+// Score of every pair of classes. Bases score match, transition (a-g, c-t) or transversion
+// against bases; N scores 0 against bases and N; a gap scores gap against bases and N, plus
+// gap_open when it opens in the column; gaps score 0 against gaps.
+struct PairWeights {
+    long long w[SCORE_CLASSES][SCORE_CLASSES] = {};
+
+    constexpr PairWeights(long long match, long long transition, long long transversion, long long gap, long long gap_open) {
+        for (size_t x = SYMBOL_A; x <= SYMBOL_T; ++x) {
+            for (size_t y = SYMBOL_A; y <= SYMBOL_T; ++y) {
+                w[x][y] = x == y ? match : (x ^ y) == 2 ? transition : transversion;
+            }
+        }
+        for (size_t x = SYMBOL_A; x <= SYMBOL_N; ++x) {
+            w[x][SYMBOL_GAP] = w[SYMBOL_GAP][x] = gap;
+            w[x][SCORE_GAP_OPEN] = w[SCORE_GAP_OPEN][x] = gap + gap_open;
+        }
+    }
+
+    long long operator()(char x, char y) const { return w[symbol_classes[x]][symbol_classes[y]]; }
+    long long gap() const { return w[SYMBOL_A][SYMBOL_GAP]; }
+};
+
+// Scoring schemes. A scheme with constant weights is a type whose weights are a constexpr table,
+// so score_counts is instantiated for it with every weight a literal and the zero terms left out.
+// An affine scheme counts the gaps opening in each column apart from the others; with column
+// counts only, a gap opening is charged against the rows with a base in that column (the
+// quasi-natural approximation of affine gaps), not recomputed over each pairwise projection.
+struct SumOfPairs {
+    static constexpr const char *name = "sp";
+    static constexpr bool constant = true;
+    static constexpr bool affine = false;
+    static constexpr PairWeights weights{1, -1, -1, -2, 0};
+};
+
+struct AffineGapSumOfPairs {
+    static constexpr const char *name = "affine";
+    static constexpr bool constant = true;
+    static constexpr bool affine = true;
+    static constexpr PairWeights weights{1, -1, -1, -1, -3};
+};
+
+struct TransitionTransversion {
+    static constexpr const char *name = "transition";
+    static constexpr bool constant = true;
+    static constexpr bool affine = false;
+    static constexpr PairWeights weights{1, -1, -2, -2, 0};
+};
+
+// Weights given on the command line; gap openings are always counted apart, which scores the
+// same as a linear scheme when gap_open is 0
+struct CustomScheme {
+    static constexpr const char *name = "custom";
+    static constexpr bool constant = false;
+    static constexpr bool affine = true;
+    static inline PairWeights weights{1, -1, -1, -2, 0};
+};
+
+template <typename Scheme, size_t X, size_t Y>
+inline long long pair_term(const uint64_t *counts) {
+    if constexpr (X > Y || (!Scheme::affine && (X == SCORE_GAP_OPEN || Y == SCORE_GAP_OPEN))) {
+        return 0;
+    } else if constexpr (Scheme::constant) {
+        constexpr long long weight = Scheme::weights.w[X][Y];
+        if constexpr (weight == 0) {
+            return 0;
+        } else if constexpr (X == Y) {
+            return weight * static_cast<long long>(counts[X] * (counts[X] - 1) / 2);
+        } else {
+            return weight * static_cast<long long>(counts[X] * counts[Y]);
+        }
+    } else {
+        const long long pairs = X == Y ? static_cast<long long>(counts[X] * (counts[X] - 1) / 2) : static_cast<long long>(counts[X] * counts[Y]);
+        return Scheme::weights.w[X][Y] * pairs;
+    }
+}
+
+template <typename Scheme, size_t... P>
+inline long long score_counts(const uint64_t *counts, std::index_sequence<P...>) {
+    return (pair_term<Scheme, P / SCORE_CLASSES, P % SCORE_CLASSES>(counts) + ...);
+}
+
+// SP score of a column from its SCORE_CLASSES counts. The counts are 64-bit, so the pair products
+// stay exact for any practical number of rows (a 32-bit a * (a - 1) overflows past 65536)
+template <typename Scheme>
+long long score_counts(const uint64_t *counts) {
+    return score_counts<Scheme>(counts, std::make_index_sequence<SCORE_CLASSES * SCORE_CLASSES>());
+}
+
+// Scoring class of the next character of a row; previous_gap carries whether the one before was
+// a gap (false at the first column, so a gap there opens)
+template <typename Scheme>
+inline uint8_t score_class(char c, bool &previous_gap) {
+    const uint8_t symbol = symbol_classes[c];
+    if constexpr (Scheme::affine) {
+        const bool gap = symbol == SYMBOL_GAP;
+        const bool opens = gap && !previous_gap;
+        previous_gap = gap;
+        return opens ? SCORE_GAP_OPEN : symbol;
+    } else {
+        return symbol;
+    }
+}
+
+// Counts of columns [l, r) into counts, SCORE_CLASSES per column, in one pass over each row,
+// which reads the rows sequentially instead of striding across them once per column
+template <typename Scheme>
+void count_columns(const std::vector<std::string> &sequences, size_t l, size_t r, uint64_t *counts) {
+    for (const auto &seq : sequences) {
+        uint64_t *column = counts;
+        bool previous_gap = false;
+        for (size_t j = l; j != r; ++j, column += SCORE_CLASSES) {
+            ++column[score_class<Scheme>(seq[j], previous_gap)];
+        }
+    }
+}
+
+template <typename Scheme>
+long long score(const std::vector<std::string> &sequences, size_t l, size_t r) {
+    if (r <= l) return 0;
+    std::vector<uint64_t> counts((r - l) * SCORE_CLASSES, 0);
+    count_columns<Scheme>(sequences, l, r, counts.data());
+    long long s = 0;
+    for (size_t j = 0; j != r - l; ++j) {
+        s += score_counts<Scheme>(&counts[j * SCORE_CLASSES]);
+    }
+    return s;
+}
+
+// The scheme chosen with -s: 'sp' (the default), 'affine', 'transition', or
+// 'custom:match,transition,transversion,gap[,gap_open]'
+class ScoringScheme {
+public:
+    enum Kind { SUM_OF_PAIRS, AFFINE, TRANSITION, CUSTOM };
+
+    Kind kind = SUM_OF_PAIRS;
+    std::string text = SumOfPairs::name;
+
+    // Select a scheme by its name; false if the text is not one
+    bool select(const std::string &value) {
+        if (value == SumOfPairs::name) {
+            kind = SUM_OF_PAIRS;
+        } else if (value == AffineGapSumOfPairs::name) {
+            kind = AFFINE;
+        } else if (value == TransitionTransversion::name) {
+            kind = TRANSITION;
+        } else if (value.compare(0, 7, "custom:") == 0) {
+            std::vector<long long> numbers;
+            const char *p = value.c_str() + 7;
+            while (true) {
+                char *end;
+                numbers.push_back(strtoll(p, &end, 10));
+                if (end == p) return false;
+                if (*end == '\0') break;
+                if (*end != ',') return false;
+                p = end + 1;
+            }
+            if (numbers.size() != 4 && numbers.size() != 5) return false;
+            CustomScheme::weights = PairWeights(numbers[0], numbers[1], numbers[2], numbers[3], numbers.size() == 5 ? numbers[4] : 0);
+            kind = CUSTOM;
+        } else {
+            return false;
+        }
+        text = value;
+        return true;
+    }
+
+    const PairWeights &weights() const {
+        switch (kind) {
+            case AFFINE: return AffineGapSumOfPairs::weights;
+            case TRANSITION: return TransitionTransversion::weights;
+            case CUSTOM: return CustomScheme::weights;
+            default: return SumOfPairs::weights;
+        }
+    }
+
+    bool affine() const {
+        return kind == AFFINE || (kind == CUSTOM && weights().w[SYMBOL_A][SCORE_GAP_OPEN] != weights().gap());
+    }
+
+    // Call f with a value of the selected scheme's type, so one call reaches its instantiation
+    template <typename F>
+    auto visit(F f) const {
+        switch (kind) {
+            case AFFINE: return f(AffineGapSumOfPairs());
+            case TRANSITION: return f(TransitionTransversion());
+            case CUSTOM: return f(CustomScheme());
+            default: return f(SumOfPairs());
+        }
+    }
+};
+
+extern ScoringScheme scoring;
+
+// SP score of columns [l, r) under the selected scheme
+long long score(const std::vector<std::string> &sequences, size_t l, size_t r) {
+    return scoring.visit([&](auto scheme) { return score<decltype(scheme)>(sequences, l, r); });
+}
+
+long long score_column(const std::vector<std::string> &sequences, size_t j) {
+    return score(sequences, j, j + 1);
+}
+
+#endif //REFINE_STAR_SCORING_H
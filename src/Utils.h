@@ -3,8 +3,14 @@
 
 #include <fstream>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <numeric>
+#include <algorithm>
 #include "Fasta.h"
+#include "AlignmentStore.h"
+#include "GapIndex.h"
+#include "Scoring.h"
 
 utils::Fasta read_from(std::string file_path) {
     std::ifstream file(file_path);
@@ -18,68 +24,35 @@ utils::Fasta read_from(std::string file_path) {
     return fasta;
 }
 
-long long score_column(std::vector<std::string> sequences, unsigned j) {
-    static constexpr long long     MISMATCH = -1;
-    static constexpr long long        MATCH =  1;
-    static constexpr long long GAPEXTENSION = -2;
-    static constexpr long long      GAPOPEN = 0;
-    unsigned counts[128];
-    memset(counts, 0, sizeof(counts));
-    for (unsigned i = 0; i != sequences.size(); ++i) {
-        char curr_base = sequences[i][j];
-        if (curr_base == 'u' || curr_base == 'U') {
-            curr_base = 't';
-        }
-        ++counts[curr_base];
+// Read a FASTA alignment, or decode a binary alignment store without parsing
+utils::Fasta read_alignment(const std::string &file_path) {
+    if (utils::AlignmentStore::is_store(file_path)) {
+        return utils::AlignmentStore(file_path).to_fasta();
     }
-
-    unsigned const a = counts['a'] + counts['A'];
-    unsigned const g = counts['g'] + counts['G'];
-    unsigned const c = counts['c'] + counts['C'];
-    unsigned const t = counts['t'] + counts['T'];
-    unsigned const gap = counts['-'];
-    unsigned const n = std::accumulate(counts, counts + 128, 0u) - a - g - c - t - gap;
-    return ((a + c) * (g + t) + a * c + g * t) * MISMATCH + ((a * (a - 1) + c * (c - 1) + g * (g - 1) + t * (t - 1)) / 2) * MATCH + ((a + c + g + t + n) * gap) * GAPEXTENSION + ((gap * (gap - 1) / 2) + (n * (n - 1) / 2) + (a + c + g + t) * gap) * GAPOPEN;
+    return read_from(file_path);
 }
 
-long long score(std::vector<std::string> sequences, unsigned l, unsigned r) {
-    long long s = 0;
-    for (unsigned i = l; i != r; ++i)
-        s += score_column(sequences, i);
-    return s;
+bool is_store_path(const std::string &file_path) {
+    return file_path.size() >= 4 && file_path.compare(file_path.size() - 4, 4, ".ras") == 0;
 }
 
-// Function to remove columns that are all gaps, modifying the input sequences in place
-void remove_all_gap_columns(std::vector<std::string>& sequences) {
-    if (sequences.empty()) {
-        return;  // No operation needed for empty input
-    }
-
-    size_t num_sequences = sequences.size();
-    size_t sequence_length = sequences[0].size();
-
-    // Create a vector to track which columns are to be kept
-    std::vector<bool> keep_column(sequence_length, false);
-
-    // Check each column to see if it contains any non-gap character
-    for (size_t j = 0; j < sequence_length; ++j) {
-        for (size_t i = 0; i < num_sequences; ++i) {
-            if (sequences[i][j] != '-') {
-                keep_column[j] = true;
-                break;  // No need to check further in this column
-            }
+// Remove the columns without bases in index, which is built on these rows or on more rows, some
+// of them since removed from it; kept runs of columns are copied whole
+void remove_all_gap_columns(std::vector<std::string>& sequences, const utils::GapIndex &index) {
+    const auto runs = index.base_column_runs();
+    if (runs.size() != 1 || runs[0].first != 0 || runs[0].second != index.columns()) {
+        size_t kept_length = 0;
+        for (const auto &run : runs) {
+            kept_length += run.second - run.first;
         }
-    }
-
-    // Filter columns in place
-    for (auto& seq : sequences) {
-        std::string new_sequence;
-        for (size_t j = 0; j < sequence_length; ++j) {
-            if (keep_column[j]) {
-                new_sequence += seq[j];
+        for (auto& seq : sequences) {
+            std::string new_sequence;
+            new_sequence.reserve(kept_length);
+            for (const auto &run : runs) {
+                new_sequence.append(seq, run.first, run.second - run.first);
             }
+            seq.swap(new_sequence);
         }
-        seq = new_sequence;
     }
 
     // Remove empty sequences if any were left
@@ -88,69 +61,118 @@ void remove_all_gap_columns(std::vector<std::string>& sequences) {
     }), sequences.end());
 }
 
-std::string find_star_sequence(const std::vector<std::string>& sequences) {
+// Function to remove columns that are all gaps, modifying the input sequences in place
+void remove_all_gap_columns(std::vector<std::string>& sequences) {
+    if (sequences.empty()) {
+        return;  // No operation needed for empty input
+    }
+    remove_all_gap_columns(sequences, utils::GapIndex(sequences));
+}
+
+// Index of the sequence with the most bases, or sequences.size() if every sequence is empty.
+// With sample_rows > 0 only about that many evenly spaced rows are considered.
+size_t find_star_index(const std::vector<std::string>& sequences, size_t sample_rows = 0) {
     unsigned long long longest_length = 0;
-    std::string star_sequence;
+    size_t star_index = sequences.size();
+    const size_t step = sample_rows > 0 && sequences.size() > sample_rows ? sequences.size() / sample_rows : 1;
 
-    for (const auto &curr : sequences) {
+    for (size_t i = 0; i < sequences.size(); i += step) {
+        const auto &curr = sequences[i];
         size_t curr_length = std::count_if(curr.begin(), curr.end(), [](char c) { return c != '-'; });
         if (curr_length > longest_length) {
-            star_sequence = curr;
+            star_index = i;
             longest_length = curr_length;
         }
     }
 
-    return star_sequence;
+    return star_index;
 }
 
-int find_string_index(const std::string& a, const std::vector<std::string>& b) {
-    // std::find returns an iterator to the found element or b.end() if not found
-    auto it = std::find(b.begin(), b.end(), a);
-
-    // Check if the element was found
-    if (it != b.end()) {
-        // Return the index by subtracting the iterator from b.begin()
-        return std::distance(b.begin(), it);
-    } else {
-        // Return -1 if the element was not found
-        return -1;
+// find_star_index over the rows left in index, counted in their order without the removed ones
+size_t find_star_index(const utils::GapIndex &index, size_t sample_rows = 0) {
+    const size_t live_rows = index.live_rows();
+    const size_t step = sample_rows > 0 && live_rows > sample_rows ? live_rows / sample_rows : 1;
+    uint32_t longest_length = 0;
+    size_t star_index = live_rows;
+    for (size_t i = 0, position = 0; i < index.rows(); ++i) {
+        if (index.is_removed(i)) continue;
+        if (position % step == 0 && index.row_bases(i) > longest_length) {
+            star_index = position;
+            longest_length = index.row_bases(i);
+        }
+        ++position;
     }
+    return star_index;
 }
 
-std::vector<int> count_characters_between_dashes(const std::string& input) {
-    std::vector<int> result;
-    int count = 0;
-    bool inside_segment = false;
+std::string find_star_sequence(const std::vector<std::string>& sequences) {
+    size_t star_index = find_star_index(sequences);
+    return star_index == sequences.size() ? std::string() : sequences[star_index];
+}
 
-    for (char c : input) {
-        if (c == '-') {
-            if (inside_segment && count > 0) {
-                result.push_back(count);
-            }
-            inside_segment = true;
-            count = 0;  // Reset the count for the next segment
-        } else if (inside_segment) {
-            ++count;
-        }
+// Lengths of the runs of bases with a gap on both sides in a row of index
+std::vector<int> count_characters_between_dashes(const utils::GapIndex &index, size_t row) {
+    std::vector<int> result;
+    for (size_t j = index.next_gap(row, 0); j < index.columns(); ) {
+        const size_t bases_begin = index.next_base(row, j);
+        j = index.next_gap(row, bases_begin);
+        if (j == index.columns()) break;
+        result.push_back(j - bases_begin);
     }
-
     return result;
 }
 
+std::vector<int> count_characters_between_dashes(const std::string& input) {
+    return count_characters_between_dashes(utils::GapIndex({input}), 0);
+}
+
 void displayHelp() {
-    std::cout << "Usage: ./realign_star -i <input_file> [-o <output_file>] [-w <window_size>] [-l <length>] [-m <msa>]" << std::endl;
+    std::cout << "Usage: ./realign_star -i <input_file> [-o <output_file>] [-w <window_size>] [-l <length>] [-m <msa>] [-r <report_file>] [-v <level>]" << std::endl;
     std::cout << "\nOptions:\n";
-    std::cout << "  -i <input_file>    (required) Path to the input file containing sequence data.\n";
-    std::cout << "  -o <output_file>   (optional) Path to the output file for storing results. Default is 'realign_star_result.fasta'.\n";
+    std::cout << "  -i <input_file>    (required) Path to the input file containing sequence data (FASTA or a '.ras' store from realign_star_pack).\n";
+    std::cout << "  -o <output_file>   (optional) Path to the output file for storing results, written as a '.ras' store if it ends with '.ras'. Default is 'realign_star_result.fasta'.\n";
     std::cout << "  -w <window_size>   (optional) Window size for sequence processing. Default is 10.\n";
     std::cout << "  -l <length>        (optional) Target length for sequence segments. Default is 5.\n";
-    std::cout << "  -m <msa>           (optional) MSA tool to use, options are 'halign3', 'mafft', or 'muscle3'. Default is 'mafft'.\n";
+    std::cout << "  -m <msa>           (optional) MSA tool to use, options are 'halign3', 'mafft', 'muscle3' or 'mock'. Default is 'mafft'.\n";
+    std::cout << "  -r <report_file>   (optional) Write per-stage timings, per-block counters and peak RSS to this file (CSV if it ends with '.csv', JSON otherwise).\n";
+    std::cout << "  -v <level>         (optional) Console verbosity: 0 quiet, 1 normal, 2 debug. Default is 1.\n";
+    std::cout << "  -iter <n>          (optional) Number of realignment passes; later passes only revisit gap regions next to blocks changed by the previous one. 0 repeats until converged. Default is 1.\n";
+    std::cout << "  -min-gain <sp>     (optional) Stop iterating when a pass improves the SP score by less than this. Default is 1.\n";
+    std::cout << "  -a <new_file>      (optional) Add the sequences of this FASTA file to a previous ReAlign-Star result given with -i, realigning only the regions they touch; a file without sequences leaves the input unchanged. Cannot be combined with -iter, -divergent, -garbage-cluster, -sample, -checkpoint, -resume or -column-stats.\n";
+    std::cout << "  -chunk <columns>   (optional) Process the alignment in windows of about this many columns read from a memory-mapped input, bounding memory by the window size. Cannot be combined with -iter, -divergent, -garbage-cluster, -sample, -checkpoint, -resume or -column-stats.\n";
+    std::cout << "  -t <threads>       (optional) Number of gap regions realigned concurrently, also the CPU budget of the aligner jobs; finished blocks are stitched in order while later ones run. Default is 1.\n";
+    std::cout << "  -mem <MB>          (optional) Memory budget of the concurrent aligner jobs; a job waits until its estimated footprint (corrected by the peak RSS measured on earlier jobs) fits. Default is the physical memory.\n";
+    std::cout << "  -mem-cap <MB>      (optional) Also cap the address space of every aligner process at this many MB, so a runaway job fails instead of swapping. Not applied to halign3 or the profile aligner, which run on the JVM; threaded mafft reserves much more address space than it uses, so leave room. Default is 0 (no cap).\n";
+    std::cout << "  -prefilter <level> (optional) Skip blocks before realignment that cannot gain (1: only provably, e.g. rows already pairwise optimal) or are unlikely to (2: also blocks without internal gaps or without gain on a banded realignment of sampled row pairs); 0 disables. Default is 1.\n";
+    std::cout << "  -prefilter-audit <0|1> (optional) Also realign the blocks the pre-filter skips, without using the result, and log how many of them would have improved.\n";
+    std::cout << "  -sample <rows>     (optional) Choose the star sequence, from which gap regions are detected, among about this many evenly spaced rows instead of all of them. Default is all rows.\n";
+    std::cout << "  -worker <port>     (optional) Run as a worker: serve block jobs from a coordinator on this TCP port of the loopback address (or host:port; '*:port' for every interface) until interrupted. -t and -mem apply to the jobs it runs. Jobs are not authenticated and run the aligners on the data they carry, so only expose a worker on a trusted network.\n";
+    std::cout << "  -workers <list>    (optional) Comma-separated host:port list of workers to realign the blocks on; list a worker several times to keep several jobs in flight on it. Blocks fall back to the local aligner if no worker is left.\n";
+    std::cout << "  -daemon <socket>   (optional) With -i, load the alignment once and serve requests on this Unix socket until 'shutdown': 'realign [w=..] [l=..] [m=..] [iter=..] [min_gain=..] [sample=..] [divergent=..] [garbage_cluster=..] [o=..]', 'export o=..', 'stats'. A realign request runs the same steps as a normal run, with the options the daemon was started with for the values it does not give; invalid values get an ERROR reply. Repeated requests reuse the garbage scan and every realigned block.\n";
+    std::cout << "  -request <text>    (optional) Send this request to the daemon at the -daemon socket and print its reply.\n";
+    std::cout << "  -divergent <distance> (optional) Also treat as garbage the rows whose estimated per-base divergence from the consensus (from MinHash sketches of 12-mers, computed -t rows at a time) exceeds this, e.g. 0.2; rows with fewer than 16 distinct 12-mers are left to the gap-based scan. Default is 0 (off).\n";
+    std::cout << "  -garbage-cluster <distance> (optional) Instead of adding the garbage sequences to the profile one at a time, cluster them by k-mer distance (0 to 1, members within this distance of the cluster leader), center-star align the clusters (-t at a time) and add them in a single profile-profile alignment. Default is 0 (one at a time).\n";
+    std::cout << "  -checkpoint <dir>  (optional) Record every realigned block and, once a minute, the profile merge progress in this directory, so that an interrupted run can be resumed.\n";
+    std::cout << "  -resume <dir>      (optional) Like -checkpoint, but first reuse the checkpoints of an earlier run on the same input and parameters found in this directory. Not supported with -chunk or -a.\n";
+    std::cout << "  -s <scheme>        (optional) Scoring scheme of the SP score that decides whether a block is kept: 'sp' (match 1, mismatch -1, gap -2), 'affine' (match 1, mismatch -1, gap -1, gap opening -3 more), 'transition' (match 1, transition -1, transversion -2, gap -2) or 'custom:<match>,<transition>,<transversion>,<gap>[,<gap opening>]'. Default is 'sp'.\n";
+    std::cout << "  -approx-sp <rows>  (optional) Decide whether a realigned block is kept from the SP scores of about this many sampled rows (one per stratum of consecutive rows), with a confidence interval of 3 standard errors on the gain; the whole block is scored only when the interval contains 0. Reported SP scores of blocks decided this way are estimates. Default is 0 (exact).\n";
+    std::cout << "  -hugepages <policy> (optional) Huge pages for the rows of the alignment, as loaded, compacted and after every realignment pass: 'thp' advises the kernel to back them with transparent huge pages, 'collapse' also collapses them into huge pages right away (Linux 6.1 or later). Default is 'off'.\n";
+    std::cout << "  -numa <policy>     (optional) NUMA placement of the rows of the alignment, as loaded, compacted and after every realignment pass: 'interleave' spreads their pages over the nodes, 'partition' moves each node's share of the rows to it; worker threads are pinned to the nodes in turn. Does nothing on a single-node machine. Default is 'off'.\n";
+    std::cout << "  -column-stats <file> (optional) Write per-column statistics of the input and of the result to this TSV file: rows, gaps, gap fraction, Shannon entropy of the non-gap symbols and SP score of each column under the -s scheme, from the column counts of the SP scoring. Each costs one extra pass over the alignment; with garbage rows the result is read back from the output. The total SP scores are logged and reported. Not supported with -chunk or -a.\n";
+    std::cout << "  -mock-latency <ms> (optional) Simulated latency of each '-m mock' aligner call. Default is 0.\n";
     std::cout << "\nExamples:\n";
     std::cout << "  ./realign_star -i data.fasta -o results.fasta -w 20 -l 10 -m halign3\n";
     std::cout << "  ./realign_star -i data.fasta -m muscle3\n";
+    std::cout << "  ./realign_star -i data.fasta -r report.json -v 0\n";
+    std::cout << "  ./realign_star -i yesterday_result.fasta -a new_genomes.fasta -o today_result.fasta\n";
+    std::cout << "  ./realign_star -i data.fasta -daemon /tmp/rs.sock &  ./realign_star -daemon /tmp/rs.sock -request 'realign w=20 l=10 o=out.fasta'\n";
+    std::cout << "  ./realign_star -i data.fasta -checkpoint ckpt/  (after an interruption: ./realign_star -i data.fasta -resume ckpt/)\n";
+    std::cout << "  ./realign_star -worker 7000 -t 8 &  ./realign_star -i data.fasta -workers localhost:7000,localhost:7000\n";
     std::cout << "\nNote:\n";
     std::cout << "  - The '-i' option is required.\n";
-    std::cout << "  - The '-m' option only supports 'halign3', 'mafft', and 'muscle3'.\n";
+    std::cout << "  - The '-m' option only supports 'halign3', 'mafft', 'muscle3' and 'mock'.\n";
+    std::cout << "  - Each aligner call picks its strategy from the block size, e.g. mafft L-INS-i for blocks of up to 200 rows and '--thread' on spare cores for large ones; the '-r' report lists the choice per block.\n";
+    std::cout << "  - '-m mock' is a built-in deterministic aligner for profiling without external tools; it only pads blocks with gaps.\n";
     std::cout << "  - If '-w' or '-l' are not provided, default values of 10 and 5 will be used respectively.\n";
 }
 
@@ -4,12 +4,32 @@
 #include <algorithm>
 #include <filesystem>
 #include <chrono>
+#include <sstream>
 #include "Fasta.h"
 #include "GapRegion.h"
 #include "Utils.h"
 #include "Garbage.h"
+#include "Report.h"
+#include "ProfileMerge.h"
+#include "Chunked.h"
+#include "Append.h"
+#include "Daemon.h"
+#include "Checkpoint.h"
+#include "IdTable.h"
+#include "ColumnStats.h"
+#include "Pipeline.h"
 
 std::string tmp_folder;
+unsigned mock_latency_ms = 0;
+unsigned thread_count = 1;
+ResourceBudget budget;
+Prefilter prefilter;
+ScoringScheme scoring;
+ApproximateScore approximate_score;
+MemoryPlacement placement;
+RemoteWorkers remote_workers;
+Logger logger;
+Report report;
 
 int main(int argc, char **argv) {
     // Check if the program was called with no arguments or with the "-h" option
@@ -18,7 +38,15 @@ int main(int argc, char **argv) {
         return 0;
     }
     
-    std::string input_file, window, length, msa;
+    std::string input_file, window, length, msa, report_file, append_file, worker_address, daemon_socket, daemon_request, checkpoint_dir, column_stats_file;
+    bool resume = false;
+    size_t chunk_columns = 0;
+    size_t sample_rows = 0;
+    uint64_t memory_mb = 0;
+    double garbage_cluster_distance = 0;
+    double max_divergence = 0;
+    int iterations = 1;
+    long long min_gain = 1;
     std::string output_file = "realign_star_result.fasta";
 
 
@@ -43,6 +71,68 @@ int main(int argc, char **argv) {
             } else if (option == "-m") {
                 msa = value;
                 have_msa = true;
+            } else if (option == "-r") {
+                report_file = value;
+            } else if (option == "-v") {
+                logger.set_level(atoi(value.c_str()));
+            } else if (option == "-a") {
+                append_file = value;
+            } else if (option == "-iter") {
+                iterations = atoi(value.c_str());
+            } else if (option == "-min-gain") {
+                min_gain = atoll(value.c_str());
+            } else if (option == "-chunk") {
+                chunk_columns = strtoul(value.c_str(), nullptr, 10);
+            } else if (option == "-t") {
+                thread_count = std::max(1, atoi(value.c_str()));
+            } else if (option == "-mem") {
+                memory_mb = strtoull(value.c_str(), nullptr, 10);
+            } else if (option == "-s") {
+                if (!scoring.select(value)) {
+                    std::cerr << "** Error: Unknown scoring scheme " << value << "." << std::endl;
+                    return 1;
+                }
+            } else if (option == "-approx-sp") {
+                approximate_score.sample_rows = strtoull(value.c_str(), nullptr, 10);
+            } else if (option == "-hugepages") {
+                if (!placement.select_huge_pages(value)) {
+                    std::cerr << "** Error: Unknown huge page policy " << value << "." << std::endl;
+                    return 1;
+                }
+            } else if (option == "-numa") {
+                if (!placement.select_numa(value)) {
+                    std::cerr << "** Error: Unknown NUMA policy " << value << "." << std::endl;
+                    return 1;
+                }
+            } else if (option == "-mem-cap") {
+                budget.address_space_cap = strtoull(value.c_str(), nullptr, 10) << 20;
+            } else if (option == "-prefilter") {
+                prefilter.level = atoi(value.c_str());
+            } else if (option == "-prefilter-audit") {
+                prefilter.audit = atoi(value.c_str()) != 0;
+            } else if (option == "-sample") {
+                sample_rows = strtoull(value.c_str(), nullptr, 10);
+            } else if (option == "-worker") {
+                worker_address = value;
+            } else if (option == "-workers") {
+                remote_workers.configure(value);
+            } else if (option == "-daemon") {
+                daemon_socket = value;
+            } else if (option == "-request") {
+                daemon_request = value;
+            } else if (option == "-divergent") {
+                max_divergence = atof(value.c_str());
+            } else if (option == "-garbage-cluster") {
+                garbage_cluster_distance = atof(value.c_str());
+            } else if (option == "-checkpoint") {
+                checkpoint_dir = value;
+            } else if (option == "-resume") {
+                checkpoint_dir = value;
+                resume = true;
+            } else if (option == "-column-stats") {
+                column_stats_file = value;
+            } else if (option == "-mock-latency") {
+                mock_latency_ms = atoi(value.c_str());
             } else {
                 std::cerr << "** Unknown option: " << option << std::endl;
                 displayHelp();
@@ -67,19 +157,75 @@ int main(int argc, char **argv) {
         msa = "mafft";
     }
 
+    PipelineOptions options;
+    options.msa = msa;
+    options.window_length = atoi(window.c_str());
+    options.min_region_length = atoi(length.c_str());
+    options.iterations = iterations;
+    options.min_gain = min_gain;
+    options.sample_rows = sample_rows;
+    options.max_divergence = max_divergence;
+    options.garbage_cluster_distance = garbage_cluster_distance;
+
+    if (!daemon_request.empty()) {
+        if (daemon_socket.empty()) {
+            std::cerr << "** Error: -request needs the -daemon socket to send it to." << std::endl;
+            return 1;
+        }
+        return send_daemon_request(daemon_socket, daemon_request);
+    }
+
     // Check if required -i option is provided
-    if (input_file.empty()) {
+    if (input_file.empty() && worker_address.empty()) {
         std::cerr << "** Error: -i option is required." << std::endl;
         displayHelp();
         return 1;
     }
 
-    if (msa != "halign3" && msa != "mafft" && msa != "muscle3") {
+    if (!is_supported_msa(msa)) {
         std::cerr << "** Error: This MSA tool is not supported." << std::endl;
         displayHelp();
         return 1; 
     }
 
+    // Chunked and append run their own pipeline, without the steps below
+    if (chunk_columns > 0 || !append_file.empty()) {
+        std::vector<std::string> unsupported;
+        if (iterations != 1) unsupported.push_back("-iter");
+        if (max_divergence > 0) unsupported.push_back("-divergent");
+        if (garbage_cluster_distance > 0) unsupported.push_back("-garbage-cluster");
+        if (sample_rows > 0) unsupported.push_back("-sample");
+        if (!checkpoint_dir.empty()) unsupported.push_back(resume ? "-resume" : "-checkpoint");
+        if (!column_stats_file.empty()) unsupported.push_back("-column-stats");
+        if (!unsupported.empty()) {
+            std::string names;
+            for (const auto &name : unsupported) {
+                names += (names.empty() ? "" : ", ") + name;
+            }
+            std::cerr << "** Error: " << names << " cannot be combined with " << (chunk_columns > 0 ? "-chunk" : "-a") << "." << std::endl;
+            return 1;
+        }
+    }
+
+    // Without -mem the aligner jobs may share the physical memory of the node
+    if (memory_mb == 0) {
+        memory_mb = static_cast<uint64_t>(sysconf(_SC_PHYS_PAGES)) * sysconf(_SC_PAGE_SIZE) >> 20;
+    }
+    budget.configure(memory_mb << 20, thread_count);
+
+    // Keep every worker slot busy; the local budget only applies to jobs that run here
+    if (remote_workers.enabled()) {
+        thread_count = std::max<unsigned>(thread_count, remote_workers.slots());
+    }
+
+    if (!report_file.empty()) {
+        report.set_info("input", input_file);
+        report.set_info("msa", msa);
+        report.set_info("window", window);
+        report.set_info("length", length);
+        report.set_info("scoring", scoring.text);
+    }
+
     // Step 1: Create a random tmp folder using timestamp and random number
     auto timestamp = std::chrono::system_clock::now().time_since_epoch().count();
     int random_number = rand() % 10000;
@@ -90,610 +236,165 @@ int main(int argc, char **argv) {
         std::cerr << "** Error: Failed to create temporary directory." << std::endl;
         return 1;
     }
-    std::cout << "Temporary folder created: " << tmp_folder << std::endl;
-
-    // Define the path to profileAlignment.jar in the install directory
-    const std::string jar_path = std::string(std::getenv("HOME")) + "/.realign_star/bin/profileAlignment.jar";
-
-    std::string garbage_file = tmp_folder + "/current_bad_sequence.fasta";
-    std::string realigned_profile = tmp_folder + "/realigned_profile.fasta";
-
-    std::vector<std::string> final_sequence;
-    utils::Fasta alignment = read_from(input_file);
-
-    std::vector<unsigned int> raw_index(alignment.identifications.size());
-    std::iota(raw_index.begin(), raw_index.end(), 0);
-
-
-    //*********** Find garbage sequences - START ***********//
-    std::unordered_set<unsigned int> garbage_index = scan_sequences(alignment.sequences, atoi(window.c_str()));
-    //*********** Find garbage sequences -  END  ***********//
-    if (msa == "muscle3") {
-        if (garbage_index.empty()) {
-            
-            std::string star_sequence = find_star_sequence(alignment.sequences);
-            std::cout << "star sequence: " << star_sequence;
-            std::cout << std::endl;
-
-            double distance = 0;
-
-            if (alignment.sequences.size() > 1000) {
-                distance = 10;
-            } else {
-                std::vector<int> base_count = count_characters_between_dashes(star_sequence);
-                int sum = std::accumulate(base_count.begin(), base_count.end(), 0);
-                distance = static_cast<double>(sum) / base_count.size();
-                
-                if (distance > 10) {
-                    distance = 10;
-                }
-            }
-
-            std::vector<std::pair<int, int>> gap_regions = find_gap_regions_roughly(star_sequence, distance, atoi(length.c_str()));
-
-            std::cout << "Gap regions: ";
-            for (const auto &region : gap_regions) {
-                std::cout << "(" << region.first << ", " << region.second << ") ";
-            }
-            std::cout << std::endl;
-
-            if (gap_regions.empty()) {
-                std::ofstream ofs(output_file);
-                alignment.write_to(ofs);
-                ofs.close();
-                std::cout << "No bad blocks to realign." << std::endl;
-                std::filesystem::remove_all(tmp_folder);
-                exit(0);
-            }
-
-            if (final_sequence.empty()) {
-                final_sequence.resize(alignment.sequences.size(), "");
-            }
+    logger.log(LOG_INFO, "Temporary folder created: ", tmp_folder);
 
-            if (gap_regions.size() == 1) {
-                int curr_start = gap_regions[0].first;
-                int curr_end = gap_regions[0].second;
-                if (curr_start == 0) {
-                    auto realigned_block = realign_block_muscle(alignment.identifications, alignment.sequences, curr_start, curr_end);
-                    join_blocks(final_sequence, realigned_block);
-                    auto non_realign_region = slice_alignment(alignment.sequences, curr_end + 1, alignment.sequences[0].length() - 1).first;
-                    join_blocks(final_sequence, std::vector<std::string>(non_realign_region.begin(), non_realign_region.end()));
-                } else {
-                    auto non_realign_region = slice_alignment(alignment.sequences, 0, curr_start - 1).first;
-                    join_blocks(final_sequence, std::vector<std::string>(non_realign_region.begin(), non_realign_region.end()));
-                    auto realigned_block = realign_block_muscle(alignment.identifications, alignment.sequences,curr_start, curr_end);
-                    join_blocks(final_sequence, realigned_block);
-                    non_realign_region = slice_alignment(alignment.sequences, curr_end + 1, alignment.sequences[0].length() - 1).first;
-                    join_blocks(final_sequence, std::vector<std::string>(non_realign_region.begin(), non_realign_region.end()));
-                }
-                std::ofstream ofs(output_file);
-                alignment.sequences = final_sequence;
-                alignment.write_to(ofs);
-                ofs.close();
-                std::filesystem::remove_all(tmp_folder);
-                exit(0);
-            }
-
-            for (size_t i = 0; i < gap_regions.size(); ++i) {
-                int curr_start = gap_regions[i].first;
-                int curr_end = gap_regions[i].second;
-
-                if (i == 0) {
-                    if (curr_start == 0) {
-                        auto realigned_block = realign_block_muscle(alignment.identifications, alignment.sequences, curr_start, curr_end);
-                        join_blocks(final_sequence, realigned_block);
-                        auto non_realign_region = slice_alignment(alignment.sequences, curr_end + 1, gap_regions[i + 1].first - 1).first;
-                        join_blocks(final_sequence, std::vector<std::string>(non_realign_region.begin(), non_realign_region.end()));
-                    } else {
-                        auto non_realign_region = slice_alignment(alignment.sequences, 0, curr_start - 1).first;
-                        join_blocks(final_sequence, std::vector<std::string>(non_realign_region.begin(), non_realign_region.end()));
-                        auto realigned_block = realign_block_muscle(alignment.identifications, alignment.sequences,curr_start, curr_end);
-                        join_blocks(final_sequence, realigned_block);
-                    }
-                } else if (i != gap_regions.size() - 1) {
-                    if (gap_regions[0].first == 0) {
-                        auto realigned_block = realign_block_muscle(alignment.identifications, alignment.sequences,curr_start, curr_end);
-                        join_blocks(final_sequence, realigned_block);
-                        auto non_realign_region = slice_alignment(alignment.sequences, curr_end + 1, gap_regions[i + 1].first - 1).first;
-                        join_blocks(final_sequence, std::vector<std::string>(non_realign_region.begin(), non_realign_region.end()));
-                    } else {
-                        auto non_realign_region = slice_alignment(alignment.sequences, gap_regions[i - 1].second + 1, curr_start - 1).first;
-                        join_blocks(final_sequence, std::vector<std::string>(non_realign_region.begin(), non_realign_region.end()));
-                        auto realigned_block = realign_block_muscle(alignment.identifications, alignment.sequences,curr_start, curr_end);
-                        join_blocks(final_sequence, realigned_block);
-                    }
-                } else {
-                    if (gap_regions[0].first == 0) {
-                        auto realigned_block = realign_block_muscle(alignment.identifications, alignment.sequences,curr_start, curr_end);
-                        join_blocks(final_sequence, realigned_block);
-                        auto non_realign_region = slice_alignment(alignment.sequences, curr_end + 1, alignment.sequences[0].length() - 1).first;
-                        join_blocks(final_sequence, std::vector<std::string>(non_realign_region.begin(), non_realign_region.end()));
-                    } else {
-                        auto non_realign_region = slice_alignment(alignment.sequences, gap_regions[i - 1].second + 1, curr_start - 1).first;
-                        join_blocks(final_sequence, std::vector<std::string>(non_realign_region.begin(), non_realign_region.end()));
-                        auto realigned_block = realign_block_muscle(alignment.identifications, alignment.sequences,curr_start, curr_end);
-                        join_blocks(final_sequence, realigned_block);
-                        non_realign_region = slice_alignment(alignment.sequences, curr_end + 1, alignment.sequences[0].length() - 1).first;
-                        join_blocks(final_sequence, std::vector<std::string>(non_realign_region.begin(), non_realign_region.end()));
-                    }
-                }
-            }
-
-            std::ofstream ofs(output_file);
-            alignment.sequences = final_sequence;
-            alignment.write_to(ofs);
-            ofs.close();
-            std::filesystem::remove_all(tmp_folder);
-            exit(0);
-        }
-        
-        //*********** Find garbage sequences - START ***********//
-        std::vector<std::string> garbage_identifications;
-        std::vector<std::string> garbage_sequences;
-        std::vector<std::string> profile_identifications;
-        std::vector<std::string> profile_sequences;
-
-        garbage_identifications.reserve(garbage_index.size());
-        garbage_sequences.reserve(garbage_index.size());
-        profile_identifications.reserve(alignment.identifications.size() - garbage_index.size());
-        profile_sequences.reserve(alignment.identifications.size() - garbage_index.size());
-
-        for (const auto &curr_index : raw_index){
-            if (garbage_index.find(curr_index) != garbage_index.end()) {
-                garbage_identifications.push_back(alignment.identifications[curr_index]);
-                std::string curr_sequence = alignment.sequences[curr_index];
-                curr_sequence.erase(std::remove(curr_sequence.begin(), curr_sequence.end(), '-'), curr_sequence.end());
-                garbage_sequences.push_back(curr_sequence);
-            } else {
-                profile_identifications.push_back(alignment.identifications[curr_index]);
-                profile_sequences.push_back(alignment.sequences[curr_index]);
-            }
-        }
-
-        remove_all_gap_columns(profile_sequences);
-        //*********** Find garbage sequences - END ***********//
+    if (!worker_address.empty()) {
+        int status = serve_worker(worker_address, align_block_file);
+        std::filesystem::remove_all(tmp_folder);
+        return status;
+    }
 
-        std::string star_sequence = find_star_sequence(profile_sequences);
-        std::cout << "star sequence: " << star_sequence;
-        std::cout << std::endl;
+    if (!daemon_socket.empty()) {
+        int status = serve_daemon(daemon_socket, input_file, options);
+        std::filesystem::remove_all(tmp_folder);
+        return status;
+    }
 
-        double distance = 0;
+    std::string realigned_profile = tmp_folder + "/realigned_profile.fasta";
 
-        if (alignment.sequences.size() > 1000) {
-            distance = 10;
-        } else {
-            std::vector<int> base_count = count_characters_between_dashes(star_sequence);
-            int sum = std::accumulate(base_count.begin(), base_count.end(), 0);
-            distance = static_cast<double>(sum) / base_count.size();
-                
-            if (distance > 10) {
-                distance = 10;
-            }
-        }
-        
-        std::vector<std::pair<int, int>> gap_regions = find_gap_regions_roughly(star_sequence, distance, atoi(length.c_str()));
-        
-        std::cout << "Gap regions: ";
-        for (const auto &region : gap_regions) {
-            std::cout << "(" << region.first << ", " << region.second << ") ";
+    // A '.ras' output is written as FASTA first and packed at the end
+    const std::string fasta_output = is_store_path(output_file) ? tmp_folder + "/result.fasta" : output_file;
+
+    // Modes that run their own pipeline: chunked and append
+    if (chunk_columns > 0 || !append_file.empty()) {
+        int status = chunk_columns > 0
+                     ? realign_chunked(msa, input_file, fasta_output, atoi(window.c_str()), atoi(length.c_str()), chunk_columns)
+                     : append_sequences(msa, input_file, append_file, fasta_output, atoi(window.c_str()), atoi(length.c_str()));
+        prefilter.log_summary();
+        approximate_score.log_summary();
+        placement.log_summary();
+        if (status == 0 && fasta_output != output_file) {
+            report.begin_stage("pack");
+            utils::AlignmentStore::import_fasta(utils::FastaIndex(fasta_output), output_file);
+            report.end_stage();
         }
-        std::cout << std::endl;
-        
-        if (gap_regions.empty()) {
-            utils::Fasta profile;
-            profile.identifications = profile_identifications;
-            profile.sequences = profile_sequences;
-
-            std::ofstream ofs(realigned_profile);
-            profile.write_to(ofs);
-            ofs.close();
-        } else {
-            if (gap_regions.size() == 1) {
-                int curr_start = gap_regions[0].first;
-                int curr_end = gap_regions[0].second;
-                if (curr_start == 0) {
-                    auto realigned_block = realign_block_muscle(alignment.identifications, alignment.sequences, curr_start, curr_end);
-                    join_blocks(final_sequence, realigned_block);
-                    auto non_realign_region = slice_alignment(alignment.sequences, curr_end + 1, alignment.sequences[0].length() - 1).first;
-                    join_blocks(final_sequence, std::vector<std::string>(non_realign_region.begin(), non_realign_region.end()));
-                } else {
-                    auto non_realign_region = slice_alignment(alignment.sequences, 0, curr_start - 1).first;
-                    join_blocks(final_sequence, std::vector<std::string>(non_realign_region.begin(), non_realign_region.end()));
-                    auto realigned_block = realign_block_muscle(alignment.identifications, alignment.sequences,curr_start, curr_end);
-                    join_blocks(final_sequence, realigned_block);
-                    non_realign_region = slice_alignment(alignment.sequences, curr_end + 1, alignment.sequences[0].length() - 1).first;
-                    join_blocks(final_sequence, std::vector<std::string>(non_realign_region.begin(), non_realign_region.end()));
-                }
-                utils::Fasta profile;
-                profile.identifications = profile_identifications;
-                profile.sequences = final_sequence;
-
-                std::ofstream ofs(realigned_profile);
-                profile.write_to(ofs);
-                ofs.close();
-            } else {
-                if (final_sequence.empty()) {
-                    final_sequence.resize(profile_sequences.size(), "");
-                }
-
-                for (size_t i = 0; i < gap_regions.size(); ++i) {
-                    int curr_start = gap_regions[i].first;
-                    int curr_end = gap_regions[i].second;
-
-                    if (i == 0) {
-                        if (curr_start == 0) {
-                            auto realigned_block = realign_block_muscle(profile_identifications, profile_sequences, curr_start, curr_end);
-                            join_blocks(final_sequence, realigned_block);
-                            auto non_realign_region = slice_alignment(profile_sequences, curr_end + 1, gap_regions[i + 1].first - 1).first;
-                            join_blocks(final_sequence, std::vector<std::string>(non_realign_region.begin(), non_realign_region.end()));
-                        } else {
-                            auto non_realign_region = slice_alignment(profile_sequences, 0, curr_start - 1).first;
-                            join_blocks(final_sequence, std::vector<std::string>(non_realign_region.begin(), non_realign_region.end()));
-                            auto realigned_block = realign_block_muscle(profile_identifications, profile_sequences,curr_start, curr_end);
-                            join_blocks(final_sequence, realigned_block);
-                        }
-                    } else if (i != gap_regions.size() - 1) {
-                        if (gap_regions[0].first == 0) {
-                            auto realigned_block = realign_block_muscle(profile_identifications, profile_sequences,curr_start, curr_end);
-                            join_blocks(final_sequence, realigned_block);
-                            auto non_realign_region = slice_alignment(profile_sequences, curr_end + 1, gap_regions[i + 1].first - 1).first;
-                            join_blocks(final_sequence, std::vector<std::string>(non_realign_region.begin(), non_realign_region.end()));
-                        } else {
-                            auto non_realign_region = slice_alignment(profile_sequences, gap_regions[i - 1].second + 1, curr_start - 1).first;
-                            join_blocks(final_sequence, std::vector<std::string>(non_realign_region.begin(), non_realign_region.end()));
-                            auto realigned_block = realign_block_muscle(profile_identifications, profile_sequences,curr_start, curr_end);
-                            join_blocks(final_sequence, realigned_block);
-                        }
-                    } else {
-                        if (gap_regions[0].first == 0) {
-                            auto realigned_block = realign_block_muscle(profile_identifications, profile_sequences,curr_start, curr_end);
-                            join_blocks(final_sequence, realigned_block);
-                            auto non_realign_region = slice_alignment(profile_sequences, curr_end + 1, profile_sequences[0].length() - 1).first;
-                            join_blocks(final_sequence, std::vector<std::string>(non_realign_region.begin(), non_realign_region.end()));
-                        } else {
-                            auto non_realign_region = slice_alignment(profile_sequences, gap_regions[i - 1].second + 1, curr_start - 1).first;
-                            join_blocks(final_sequence, std::vector<std::string>(non_realign_region.begin(), non_realign_region.end()));
-                            auto realigned_block = realign_block_muscle(profile_identifications, profile_sequences,curr_start, curr_end);
-                            join_blocks(final_sequence, realigned_block);
-                            non_realign_region = slice_alignment(profile_sequences, curr_end + 1, profile_sequences[0].length() - 1).first;
-                            join_blocks(final_sequence, std::vector<std::string>(non_realign_region.begin(), non_realign_region.end()));
-                        }
-                    }
-                }
-
-                utils::Fasta profile;
-                profile.identifications = profile_identifications;
-                profile.sequences = final_sequence;
-
-                std::ofstream ofs(realigned_profile);
-                profile.write_to(ofs);
-                ofs.close();
-            }
+        std::filesystem::remove_all(tmp_folder);
+        if (status == 0 && !report_file.empty()) {
+            report.write_to(report_file);
         }
-        
-        utils::Fasta garbages;
-        garbages.identifications.resize(1, "");
-        garbages.sequences.resize(1, "");
-
-        // Define the path to profileAlignment.jar in the install directory
-        const std::string jar_path = std::string(std::getenv("HOME")) + "/.realign_star/bin/profileAlignment.jar";
+        return status;
+    }
 
-        // Check if profileAlignment.jar exists
-        std::ifstream jar_file(jar_path);
-        if (!jar_file.good()) {
-            std::cerr << "** Error: profileAlignment.jar not found in " << jar_path << ". Please ensure it is correctly located." << std::endl;
+    // Checkpoints only hold for the same input and the parameters that change the result
+    Checkpoint checkpoint;
+    if (!checkpoint_dir.empty()) {
+        const std::string parameters = msa + " w=" + window + " l=" + length + " iter=" + std::to_string(iterations) + " min_gain=" + std::to_string(min_gain) + " s=" + scoring.text
+                                       + " approx_sp=" + std::to_string(approximate_score.sample_rows)
+                                       + " sample=" + std::to_string(sample_rows) + " prefilter=" + std::to_string(prefilter.level)
+                                       + " garbage_cluster=" + std::to_string(garbage_cluster_distance) + " divergent=" + std::to_string(max_divergence);
+        if (!checkpoint.open(checkpoint_dir, input_file, parameters, resume)) {
             std::filesystem::remove_all(tmp_folder);
             return 1;
         }
-        jar_file.close();
-
-        for(int k = 0; k < garbage_index.size(); k++) {
-            garbages.identifications[0] = garbage_identifications[k];
-            garbages.sequences[0] = garbage_sequences[k];
-            std::ofstream garbage_path(garbage_file);
-            garbages.write_to(garbage_path);
-            garbage_path.close();
-
-            std::string command_profile_to_seq = "java -jar " + jar_path + " -i " + garbage_file + " " + realigned_profile +" -o " + output_file + " 2> /dev/null";
-            system(command_profile_to_seq.c_str());
-            std::string command_cp = "cp " + output_file + " " + realigned_profile;
-            system(command_cp.c_str());
-        }
-
-        std::filesystem::remove_all(tmp_folder);
-
-    } else {
-        if (garbage_index.empty()) {
-        
-        std::string star_sequence = find_star_sequence(alignment.sequences);
-        std::cout << "star sequence: " << star_sequence;
-        std::cout << std::endl;
-
-        std::vector<int> base_count = count_characters_between_dashes(star_sequence);
-
-        double distance = 0;
-
-        if (alignment.sequences.size() > 1000) {
-            distance = 10;
-        } else {
-            int sum = std::accumulate(base_count.begin(), base_count.end(), 0);
-            distance = static_cast<double>(sum) / base_count.size();
-            
-            if (distance > 10) {
-                distance = 10;
-            }
-        }
-        
-        std::vector<std::pair<int, int>> gap_regions = find_gap_regions_roughly(star_sequence, distance, atoi(length.c_str()));
-
-        if (gap_regions.empty()) {
-            std::ofstream ofs(output_file);
-            alignment.write_to(ofs);
-            ofs.close();
-            std::cout << "No bad blocks to realign." << std::endl;
-            std::filesystem::remove_all(tmp_folder);
-            exit(0);
-        }
-
-        if (final_sequence.empty()) {
-            final_sequence.resize(alignment.sequences.size(), "");
-        }
-
-        if (gap_regions.size() == 1) {
-            int curr_start = gap_regions[0].first;
-            int curr_end = gap_regions[0].second;
-            if (curr_start == 0) {
-                auto realigned_block = realign_block(msa, alignment.identifications, alignment.sequences, curr_start, curr_end);
-                join_blocks(final_sequence, realigned_block);
-                auto non_realign_region = slice_alignment(alignment.sequences, curr_end + 1, alignment.sequences[0].length() - 1).first;
-                join_blocks(final_sequence, std::vector<std::string>(non_realign_region.begin(), non_realign_region.end()));
-            } else {
-                auto non_realign_region = slice_alignment(alignment.sequences, 0, curr_start - 1).first;
-                join_blocks(final_sequence, std::vector<std::string>(non_realign_region.begin(), non_realign_region.end()));
-                auto realigned_block = realign_block(msa, alignment.identifications, alignment.sequences,curr_start, curr_end);
-                join_blocks(final_sequence, realigned_block);
-                non_realign_region = slice_alignment(alignment.sequences, curr_end + 1, alignment.sequences[0].length() - 1).first;
-                join_blocks(final_sequence, std::vector<std::string>(non_realign_region.begin(), non_realign_region.end()));
-            }
-            std::ofstream ofs(output_file);
-            alignment.sequences = final_sequence;
-            alignment.write_to(ofs);
-            ofs.close();
+    }
+    BlockCache *cache = checkpoint.enabled() ? &checkpoint.blocks : nullptr;
+
+    report.begin_stage("read");
+    utils::Fasta alignment = read_alignment(input_file);
+    const size_t sequence_count = alignment.sequences.size();
+    placement.apply(alignment.sequences);
+
+    // Per-column statistics of the input are written before its rows are split up
+    std::ofstream column_stats;
+    if (!column_stats_file.empty()) {
+        report.begin_stage("column stats");
+        column_stats.open(column_stats_file);
+        if (!column_stats) {
+            std::cerr << "** Error: cannot open column statistics file " << column_stats_file << "." << std::endl;
             std::filesystem::remove_all(tmp_folder);
-            exit(0);
-        }
-
-        for (size_t i = 0; i < gap_regions.size(); ++i) {
-            int curr_start = gap_regions[i].first;
-            int curr_end = gap_regions[i].second;
-
-            if (i == 0) {
-                if (curr_start == 0) {
-                    auto realigned_block = realign_block(msa, alignment.identifications, alignment.sequences, curr_start, curr_end);
-                    join_blocks(final_sequence, realigned_block);
-                    auto non_realign_region = slice_alignment(alignment.sequences, curr_end + 1, gap_regions[i + 1].first - 1).first;
-                    join_blocks(final_sequence, std::vector<std::string>(non_realign_region.begin(), non_realign_region.end()));
-                } else {
-                    auto non_realign_region = slice_alignment(alignment.sequences, 0, curr_start - 1).first;
-                    join_blocks(final_sequence, std::vector<std::string>(non_realign_region.begin(), non_realign_region.end()));
-                    auto realigned_block = realign_block(msa, alignment.identifications, alignment.sequences,curr_start, curr_end);
-                    join_blocks(final_sequence, realigned_block);
-                }
-            } else if (i != gap_regions.size() - 1) {
-                if (gap_regions[0].first == 0) {
-                    auto realigned_block = realign_block(msa, alignment.identifications, alignment.sequences,curr_start, curr_end);
-                    join_blocks(final_sequence, realigned_block);
-                    auto non_realign_region = slice_alignment(alignment.sequences, curr_end + 1, gap_regions[i + 1].first - 1).first;
-                    join_blocks(final_sequence, std::vector<std::string>(non_realign_region.begin(), non_realign_region.end()));
-                } else {
-                    auto non_realign_region = slice_alignment(alignment.sequences, gap_regions[i - 1].second + 1, curr_start - 1).first;
-                    join_blocks(final_sequence, std::vector<std::string>(non_realign_region.begin(), non_realign_region.end()));
-                    auto realigned_block = realign_block(msa, alignment.identifications, alignment.sequences,curr_start, curr_end);
-                    join_blocks(final_sequence, realigned_block);
-                }
-            } else {
-                if (gap_regions[0].first == 0) {
-                    auto realigned_block = realign_block(msa, alignment.identifications, alignment.sequences,curr_start, curr_end);
-                    join_blocks(final_sequence, realigned_block);
-                    auto non_realign_region = slice_alignment(alignment.sequences, curr_end + 1, alignment.sequences[0].length() - 1).first;
-                    join_blocks(final_sequence, std::vector<std::string>(non_realign_region.begin(), non_realign_region.end()));
-                } else {
-                    auto non_realign_region = slice_alignment(alignment.sequences, gap_regions[i - 1].second + 1, curr_start - 1).first;
-                    join_blocks(final_sequence, std::vector<std::string>(non_realign_region.begin(), non_realign_region.end()));
-                    auto realigned_block = realign_block(msa, alignment.identifications, alignment.sequences,curr_start, curr_end);
-                    join_blocks(final_sequence, realigned_block);
-                    non_realign_region = slice_alignment(alignment.sequences, curr_end + 1, alignment.sequences[0].length() - 1).first;
-                    join_blocks(final_sequence, std::vector<std::string>(non_realign_region.begin(), non_realign_region.end()));
-                }
-            }
+            return 1;
         }
-
-        std::ofstream ofs(output_file);
-        alignment.sequences = final_sequence;
-        alignment.write_to(ofs);
-        ofs.close();
-        std::filesystem::remove_all(tmp_folder);
-        exit(0);
+        ColumnStats input_stats;
+        input_stats.add_rows(alignment.sequences);
+        ColumnStats::write_header(column_stats);
+        const long long input_sp = input_stats.write_tsv(column_stats, "input");
+        logger.log(LOG_INFO, "Input SP: ", input_sp);
+        report.set_info("input_sp", std::to_string(input_sp));
     }
-    
+
     //*********** Find garbage sequences - START ***********//
+    report.begin_stage("garbage scan");
+    // Gap positions are indexed once; the scan, compaction and star selection read the index
+    utils::GapIndex gap_index(alignment.sequences);
+    std::unordered_set<size_t> garbage_index = find_garbage_rows(options, gap_index, alignment.sequences);
+
     std::vector<std::string> garbage_identifications;
     std::vector<std::string> garbage_sequences;
-    std::vector<std::string> profile_identifications;
+    utils::IdTable profile_identifications;
     std::vector<std::string> profile_sequences;
 
+    size_t name_bytes = 0;
+    for (const auto &name : alignment.identifications) {
+        name_bytes += name.size();
+    }
+    profile_identifications.reserve(sequence_count - garbage_index.size(), name_bytes);
     garbage_identifications.reserve(garbage_index.size());
-    garbage_sequences.reserve(garbage_index.size());
-    profile_identifications.reserve(alignment.identifications.size() - garbage_index.size());
-    profile_sequences.reserve(alignment.identifications.size() - garbage_index.size());
-
-    for (const auto &curr_index : raw_index){
-        if (garbage_index.find(curr_index) != garbage_index.end()) {
-            garbage_identifications.push_back(alignment.identifications[curr_index]);
-            std::string curr_sequence = alignment.sequences[curr_index];
-            curr_sequence.erase(std::remove(curr_sequence.begin(), curr_sequence.end(), '-'), curr_sequence.end());
-            garbage_sequences.push_back(curr_sequence);
+    for (size_t curr_index = 0; curr_index < sequence_count; ++curr_index) {
+        if (garbage_index.count(curr_index)) {
+            garbage_identifications.push_back(std::move(alignment.identifications[curr_index]));
         } else {
-            profile_identifications.push_back(alignment.identifications[curr_index]);
-            profile_sequences.push_back(alignment.sequences[curr_index]);
+            profile_identifications.add(alignment.identifications[curr_index]);
         }
     }
-
-    remove_all_gap_columns(profile_sequences);
+    std::vector<std::string>().swap(alignment.identifications);
+    split_garbage(std::move(alignment.sequences), garbage_index, gap_index, profile_sequences, garbage_sequences);
+    logger.log(LOG_INFO, "Garbage sequences: ", garbage_index.size());
     //*********** Find garbage sequences - END ***********//
 
-    std::string star_sequence = find_star_sequence(profile_sequences);
-    std::cout << "star sequence: " << star_sequence;
-    std::cout << std::endl;
-
-    std::vector<int> base_count = count_characters_between_dashes(star_sequence);
+    realign_profile(options, profile_sequences, gap_index, sequence_count, cache);
+    placement.log_summary();
 
-    double distance = 0;
-    
-    if (alignment.sequences.size() > 1000) {
-            distance = 10;
-    } else {
-        int sum = std::accumulate(base_count.begin(), base_count.end(), 0);
-        distance = static_cast<double>(sum) / base_count.size();
-            
-        if (distance > 10) {
-            distance = 10;
+    // Sequence names only come back from the ID table here
+    ColumnStats result_stats;
+    if (garbage_index.empty()) {
+        report.begin_stage("write");
+        if (column_stats.is_open()) {
+            // An extra pass over the rows in memory, before they are written
+            result_stats.add_rows(profile_sequences);
         }
-    }
-
-    std::vector<std::pair<int, int>> gap_regions = find_gap_regions_roughly(star_sequence, distance, atoi(length.c_str()));
-    
-    std::cout << "Gap regions: ";
-    for (const auto &region : gap_regions) {
-        std::cout << "(" << region.first << ", " << region.second << ") ";
-    }
-    std::cout << std::endl;
-    
-    if (gap_regions.empty()) {
-        utils::Fasta profile;
-        profile.identifications = profile_identifications;
-        profile.sequences = profile_sequences;
-
-        std::ofstream ofs(realigned_profile);
-        profile.write_to(ofs);
+        std::ofstream ofs(fasta_output);
+        utils::Fasta::write_to(ofs, profile_sequences.cbegin(), profile_sequences.cend(), profile_identifications.begin());
         ofs.close();
     } else {
-        if (gap_regions.size() == 1) {
-            int curr_start = gap_regions[0].first;
-            int curr_end = gap_regions[0].second;
-            if (curr_start == 0) {
-                auto realigned_block = realign_block(msa, alignment.identifications, alignment.sequences, curr_start, curr_end);
-                join_blocks(final_sequence, realigned_block);
-                auto non_realign_region = slice_alignment(alignment.sequences, curr_end + 1, alignment.sequences[0].length() - 1).first;
-                join_blocks(final_sequence, std::vector<std::string>(non_realign_region.begin(), non_realign_region.end()));
-            } else {
-                auto non_realign_region = slice_alignment(alignment.sequences, 0, curr_start - 1).first;
-                join_blocks(final_sequence, std::vector<std::string>(non_realign_region.begin(), non_realign_region.end()));
-                auto realigned_block = realign_block(msa, alignment.identifications, alignment.sequences,curr_start, curr_end);
-                join_blocks(final_sequence, realigned_block);
-                non_realign_region = slice_alignment(alignment.sequences, curr_end + 1, alignment.sequences[0].length() - 1).first;
-                join_blocks(final_sequence, std::vector<std::string>(non_realign_region.begin(), non_realign_region.end()));
-            }
-            utils::Fasta profile;
-            profile.identifications = profile_identifications;
-            profile.sequences = final_sequence;
-
-            std::ofstream ofs(realigned_profile);
-            profile.write_to(ofs);
-            ofs.close();
-        } else {
-            if (final_sequence.empty()) {
-                final_sequence.resize(profile_sequences.size(), "");
-            }
-
-            for (size_t i = 0; i < gap_regions.size(); ++i) {
-                int curr_start = gap_regions[i].first;
-                int curr_end = gap_regions[i].second;
-
-                if (i == 0) {
-                    if (curr_start == 0) {
-                        auto realigned_block = realign_block(msa, profile_identifications, profile_sequences, curr_start, curr_end);
-                        join_blocks(final_sequence, realigned_block);
-                        auto non_realign_region = slice_alignment(profile_sequences, curr_end + 1, gap_regions[i + 1].first - 1).first;
-                        join_blocks(final_sequence, std::vector<std::string>(non_realign_region.begin(), non_realign_region.end()));
-                    } else {
-                        auto non_realign_region = slice_alignment(profile_sequences, 0, curr_start - 1).first;
-                        join_blocks(final_sequence, std::vector<std::string>(non_realign_region.begin(), non_realign_region.end()));
-                        auto realigned_block = realign_block(msa, profile_identifications, profile_sequences,curr_start, curr_end);
-                        join_blocks(final_sequence, realigned_block);
-                    }
-                } else if (i != gap_regions.size() - 1) {
-                    if (gap_regions[0].first == 0) {
-                        auto realigned_block = realign_block(msa, profile_identifications, profile_sequences,curr_start, curr_end);
-                        join_blocks(final_sequence, realigned_block);
-                        auto non_realign_region = slice_alignment(profile_sequences, curr_end + 1, gap_regions[i + 1].first - 1).first;
-                        join_blocks(final_sequence, std::vector<std::string>(non_realign_region.begin(), non_realign_region.end()));
-                    } else {
-                        auto non_realign_region = slice_alignment(profile_sequences, gap_regions[i - 1].second + 1, curr_start - 1).first;
-                        join_blocks(final_sequence, std::vector<std::string>(non_realign_region.begin(), non_realign_region.end()));
-                        auto realigned_block = realign_block(msa, profile_identifications, profile_sequences,curr_start, curr_end);
-                        join_blocks(final_sequence, realigned_block);
-                    }
-                } else {
-                    if (gap_regions[0].first == 0) {
-                        auto realigned_block = realign_block(msa, profile_identifications, profile_sequences,curr_start, curr_end);
-                        join_blocks(final_sequence, realigned_block);
-                        auto non_realign_region = slice_alignment(profile_sequences, curr_end + 1, profile_sequences[0].length() - 1).first;
-                        join_blocks(final_sequence, std::vector<std::string>(non_realign_region.begin(), non_realign_region.end()));
-                    } else {
-                        auto non_realign_region = slice_alignment(profile_sequences, gap_regions[i - 1].second + 1, curr_start - 1).first;
-                        join_blocks(final_sequence, std::vector<std::string>(non_realign_region.begin(), non_realign_region.end()));
-                        auto realigned_block = realign_block(msa, profile_identifications, profile_sequences,curr_start, curr_end);
-                        join_blocks(final_sequence, realigned_block);
-                        non_realign_region = slice_alignment(profile_sequences, curr_end + 1, profile_sequences[0].length() - 1).first;
-                        join_blocks(final_sequence, std::vector<std::string>(non_realign_region.begin(), non_realign_region.end()));
-                    }
-                }
-            }
-
-            utils::Fasta profile;
-            profile.identifications = profile_identifications;
-            profile.sequences = final_sequence;
+        report.begin_stage("profile merge");
+        std::ofstream ofs(realigned_profile);
+        utils::Fasta::write_to(ofs, profile_sequences.cbegin(), profile_sequences.cend(), profile_identifications.begin());
+        ofs.close();
+        std::vector<std::string>().swap(profile_sequences);
 
-            std::ofstream ofs(realigned_profile);
-            profile.write_to(ofs);
-            ofs.close();
+        // Check if profileAlignment.jar exists
+        if (!profile_aligner_available(msa)) {
+            std::cerr << "** Error: profileAlignment.jar not found in " << profile_aligner_path() << ". Please ensure it is correctly located." << std::endl;
+            std::filesystem::remove_all(tmp_folder);
+            return 1;
         }
-    }
-    
-
-    utils::Fasta garbages;
-    garbages.identifications.resize(1, "");
-    garbages.sequences.resize(1, "");
 
-    // Define the path to profileAlignment.jar in the install directory
-    const std::string jar_path = std::string(std::getenv("HOME")) + "/.realign_star/bin/profileAlignment.jar";
-
-    // Check if profileAlignment.jar exists
-    std::ifstream jar_file(jar_path);
-    if (!jar_file.good()) {
-        std::cerr << "** Error: profileAlignment.jar not found in " << jar_path << ". Please ensure it is correctly located." << std::endl;
-        std::filesystem::remove_all(tmp_folder);
-        return 1;
+        merge_garbage(options, garbage_identifications, garbage_sequences, realigned_profile, fasta_output, checkpoint.enabled() ? &checkpoint : nullptr);
+    }
+    // Garbage rows are merged into the result by the profile aligner, so then the result is
+    // counted in an extra pass that reads the written output back
+    if (column_stats.is_open()) {
+        report.begin_stage("column stats");
+        if (!garbage_index.empty()) {
+            std::ifstream merged(fasta_output);
+            result_stats.add_rows(merged);
+        }
+        const long long result_sp = result_stats.write_tsv(column_stats, "result");
+        column_stats.close();
+        logger.log(LOG_INFO, "Result SP: ", result_sp);
+        report.set_info("result_sp", std::to_string(result_sp));
     }
-    jar_file.close();
-
-    for(int k = 0; k < garbage_index.size(); k++) {
-        garbages.identifications[0] = garbage_identifications[k];
-        garbages.sequences[0] = garbage_sequences[k];
-        std::ofstream garbage_path(garbage_file);
-        garbages.write_to(garbage_path);
-        garbage_path.close();
-
-        std::string command_profile_to_seq = "java -jar " + jar_path + " -i " + garbage_file + " " + realigned_profile +" -o " + output_file + " 2> /dev/null";
-        system(command_profile_to_seq.c_str());
-        std::string command_cp = "cp " + output_file + " " + realigned_profile;
-        system(command_cp.c_str());
+    if (fasta_output != output_file) {
+        report.begin_stage("pack");
+        utils::AlignmentStore::import_fasta(utils::FastaIndex(fasta_output), output_file);
     }
+    report.end_stage();
 
     std::filesystem::remove_all(tmp_folder);
 
-    } 
+    if (!report_file.empty()) {
+        report.write_to(report_file);
+    }
 
     return 0;
 }
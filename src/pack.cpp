@@ -0,0 +1,47 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include "Fasta.h"
+#include "FastaIndex.h"
+#include "AlignmentStore.h"
+
+void displayHelp() {
+    std::cout << "Usage: ./realign_star_pack import <alignment.fasta> <alignment.ras>" << std::endl;
+    std::cout << "       ./realign_star_pack export <alignment.ras> <alignment.fasta>" << std::endl;
+    std::cout << "\nConvert between FASTA alignments and the binary alignment store read by realign_star.\n";
+    std::cout << "A '.ras' file can be given to realign_star -i directly, and realign_star writes one when -o ends with '.ras'.\n";
+}
+
+int main(int argc, char **argv) {
+    if (argc != 4) {
+        displayHelp();
+        return argc == 1 ? 0 : 1;
+    }
+
+    const std::string command = argv[1];
+    if (command == "import") {
+        utils::FastaIndex index(argv[2]);
+        utils::AlignmentStore::import_fasta(index, argv[3]);
+    } else if (command == "export") {
+        utils::AlignmentStore store(argv[2]);
+        std::ofstream ofs(argv[3]);
+        if (!ofs) {
+            std::cerr << "Error: cannot open file " << argv[3] << std::endl;
+            return 1;
+        }
+        std::string row;
+        for (size_t i = 0; i < store.rows(); ++i) {
+            row.clear();
+            store.read_columns(i, 0, store.length(i), row);
+            ofs << '>' << store.identification(i) << '\n';
+            utils::Fasta::cut_and_write(ofs, row);
+            if (i != store.rows() - 1) ofs << '\n';
+        }
+        ofs.close();
+    } else {
+        std::cerr << "** Unknown command: " << command << std::endl;
+        displayHelp();
+        return 1;
+    }
+    return 0;
+}